@@ -64,6 +64,11 @@ void MainWindow::dataChanged()
     setWindowModified(hexEdit->isModified());
 }
 
+void MainWindow::editTooLarge(qint64 size)
+{
+    statusBar()->showMessage(tr("%1 bytes are too many for one edit").arg(size), 4000);
+}
+
 void MainWindow::open()
 {
     QString fileName = QFileDialog::getOpenFileName(this);
@@ -190,6 +195,7 @@ void MainWindow::init()
     setCentralWidget(hexEdit);
     connect(hexEdit, SIGNAL(overwriteModeChanged(bool)), this, SLOT(setOverwriteMode(bool)));
     connect(hexEdit, SIGNAL(dataChanged()), this, SLOT(dataChanged()));
+    connect(hexEdit, SIGNAL(editTooLarge(qint64)), this, SLOT(editTooLarge(qint64)));
     searchDialog = new SearchDialog(hexEdit, this);
 
     createActions();
@@ -379,16 +385,29 @@ bool MainWindow::saveFile(const QString &fileName)
     QString tmpFileName = fileName + ".~tmp";
 
     QApplication::setOverrideCursor(Qt::WaitCursor);
+
+    // Overwritten bytes are patched into the loaded file, nothing else is written
+    bool ok = false;
+    if (!isUntitled && (QFileInfo(fileName).canonicalFilePath() == curFile))
+    {
+        QFile patched(fileName);
+        ok = hexEdit->writeChanges(patched);
+    }
+
+    // Otherwise the whole data is written
     QFile file(tmpFileName);
-    bool ok = hexEdit->write(file);
-    if (QFile::exists(fileName))
-        ok = QFile::remove(fileName);
-    if (ok)
+    if (!ok)
     {
-        file.setFileName(tmpFileName);
-        ok = file.copy(fileName);
+        ok = hexEdit->write(file);
+        if (QFile::exists(fileName))
+            ok = QFile::remove(fileName);
         if (ok)
-            ok = QFile::remove(tmpFileName);
+        {
+            file.setFileName(tmpFileName);
+            ok = file.copy(fileName);
+            if (ok)
+                ok = QFile::remove(tmpFileName);
+        }
     }
     QApplication::restoreOverrideCursor();
 
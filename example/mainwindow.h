@@ -31,6 +31,7 @@ protected:
 private slots:
     void about();
     void dataChanged();
+    void editTooLarge(qint64 size);
     void open();
     void optionsAccepted();
     void findNext();
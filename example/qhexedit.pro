@@ -5,6 +5,14 @@ HEADERS = \
     optionsdialog.h \
     ../src/qhexedit.h \
     ../src/chunks.h \
+    ../src/chunktree.h \
+    ../src/changedbits.h \
+    ../src/chunkspill.h \
+    ../src/searchengine.h \
+    ../src/parallelsearch.h \
+    ../src/matchindex.h \
+    ../src/viewloader.h \
+    ../src/glyphatlas.h \
     ../src/commands.h \
     searchdialog.h
 
@@ -15,6 +23,14 @@ SOURCES = \
     optionsdialog.cpp \
     ../src/qhexedit.cpp \
     ../src/chunks.cpp \
+    ../src/chunktree.cpp \
+    ../src/changedbits.cpp \
+    ../src/chunkspill.cpp \
+    ../src/searchengine.cpp \
+    ../src/parallelsearch.cpp \
+    ../src/matchindex.cpp \
+    ../src/viewloader.cpp \
+    ../src/glyphatlas.cpp \
     ../src/commands.cpp \
     searchdialog.cpp
 
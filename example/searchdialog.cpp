@@ -34,7 +34,38 @@ qint64 SearchDialog::findNext()
 
 void SearchDialog::on_pbFind_clicked()
 {
-    findNext();
+    // The search runs in the background, a second click stops it
+    if (_search)
+    {
+        _search->cancel();
+        return;
+    }
+
+    qint64 from = _hexEdit->cursorPosition() / 2;
+    _findBa = getContent(ui->cbFindFormat->currentIndex(), ui->cbFind->currentText());
+    if (_findBa.length() > 0)
+    {
+        if (ui->cbBackwards->isChecked())
+            _search = _hexEdit->startLastIndexOf(_findBa, from);
+        else
+            _search = _hexEdit->startIndexOf(_findBa, from);
+        connect(_search, SIGNAL(progress(qint64,qint64)), this, SLOT(searchProgress(qint64,qint64)));
+        connect(_search, SIGNAL(finished()), this, SLOT(searchFinished()));
+        setSearching(true);
+    }
+}
+
+void SearchDialog::on_pbFindAll_clicked()
+{
+    _findBa = getContent(ui->cbFindFormat->currentIndex(), ui->cbFind->currentText());
+    if (_findBa.length() > 0)
+    {
+        qint64 count = _hexEdit->findAll(_findBa);
+        _hexEdit->nextMatch(_hexEdit->cursorPosition() / 2);
+        QMessageBox::information(this, tr("QHexEdit"), QString(tr("%1 occurrences found.")).arg(count));
+    }
+    else
+        _hexEdit->clearMatches();
 }
 
 void SearchDialog::on_pbReplace_clicked()
@@ -49,10 +80,24 @@ void SearchDialog::on_pbReplace_clicked()
 
 void SearchDialog::on_pbReplaceAll_clicked()
 {
-    int replaceCounter = 0;
+    qint64 replaceCounter = 0;
     int idx = 0;
     int goOn = QMessageBox::Yes;
 
+    // Without prompting, all occurences are replaced in one step. Like the prompted
+    // loop, it starts at the cursor and goes to the end, or to the begin backwards.
+    if (!ui->cbPrompt->isChecked())
+    {
+        qint64 from = _hexEdit->cursorPosition() / 2;
+        _findBa = getContent(ui->cbFindFormat->currentIndex(), ui->cbFind->currentText());
+        QByteArray replaceBa = getContent(ui->cbReplaceFormat->currentIndex(), ui->cbReplace->currentText());
+        if ((_findBa.length() > 0) && ui->cbBackwards->isChecked())
+            replaceCounter = _hexEdit->replaceAll(_findBa, replaceBa, 0, from);
+        else if (_findBa.length() > 0)
+            replaceCounter = _hexEdit->replaceAll(_findBa, replaceBa, from);
+        goOn = QMessageBox::No;
+    }
+
     while ((idx >= 0) && (goOn == QMessageBox::Yes))
     {
         idx = findNext();
@@ -73,6 +118,23 @@ void SearchDialog::on_pbReplaceAll_clicked()
         QMessageBox::information(this, tr("QHexEdit"), QString(tr("%1 occurrences replaced.")).arg(replaceCounter));
 }
 
+void SearchDialog::on_pbCancel_clicked()
+{
+    if (_search)
+        _search->cancel();
+}
+
+void SearchDialog::searchProgress(qint64 scanned, qint64 total)
+{
+    if (total > 0)
+        ui->progressBar->setValue((int)(scanned * 1000 / total));
+}
+
+void SearchDialog::searchFinished()
+{
+    _search = 0;
+    setSearching(false);
+}
 
 QByteArray SearchDialog::getContent(int comboIndex, const QString &input)
 {
@@ -113,3 +175,15 @@ qint64 SearchDialog::replaceOccurrence(qint64 idx, const QByteArray &replaceBa)
     }
     return result;
 }
+
+void SearchDialog::setSearching(bool searching)
+{
+    // setText() replaces the shortcut with the mnemonic, so F3 is set again
+    QKeySequence shortcut = ui->pbFind->shortcut();
+    ui->pbFind->setText(searching ? tr("&Stop") : tr("&Find"));
+    ui->pbFind->setShortcut(shortcut);
+    ui->pbFindAll->setEnabled(!searching);
+    ui->pbReplace->setEnabled(!searching);
+    ui->pbReplaceAll->setEnabled(!searching);
+    ui->progressBar->setValue(0);
+}
@@ -2,6 +2,7 @@
 #define SEARCHDIALOG_H
 
 #include <QDialog>
+#include <QPointer>
 #include <QtCore>
 #include "../src/qhexedit.h"
 
@@ -20,15 +21,21 @@ public:
 
 private slots:
     void on_pbFind_clicked();
+    void on_pbFindAll_clicked();
     void on_pbReplace_clicked();
     void on_pbReplaceAll_clicked();
+    void on_pbCancel_clicked();
+    void searchProgress(qint64 scanned, qint64 total);
+    void searchFinished();
 
 private:
     QByteArray getContent(int comboIndex, const QString &input);
     qint64 replaceOccurrence(qint64 idx, const QByteArray &replaceBa);
+    void setSearching(bool searching);
 
     QHexEdit *_hexEdit;
     QByteArray _findBa;
+    QPointer<QHexEditSearch> _search;
 };
 
 #endif // SEARCHDIALOG_H
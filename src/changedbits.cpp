@@ -0,0 +1,272 @@
+#include "changedbits.h"
+
+static inline bool bitAt(const char *bits, int pos)
+{
+    return (bits[pos >> 3] >> (pos & 7)) & 1;
+}
+
+static inline void setBit(char *bits, int pos, bool changed)
+{
+    if (changed)
+        bits[pos >> 3] |= char(1 << (pos & 7));
+    else
+        bits[pos >> 3] &= char(~(1 << (pos & 7)));
+}
+
+static void fillBits(char *bits, int pos, int count, bool changed)
+{
+    // Single bits up to the next byte, whole bytes, single bits at the end
+    for (; (count > 0) && (pos & 7); pos++, count--)
+        setBit(bits, pos, changed);
+    memset(bits + (pos >> 3), changed ? 0xff : 0, count >> 3);
+    pos += count & ~7;
+    for (count &= 7; count > 0; pos++, count--)
+        setBit(bits, pos, changed);
+}
+
+static void addRange(ChangedRanges &ranges, qint64 pos, qint64 size)
+{
+    if (!ranges.isEmpty() && ((ranges.last().pos + ranges.last().size) == pos))
+        ranges.last().size += size;
+    else
+    {
+        ChangedRange range;
+        range.pos = pos;
+        range.size = size;
+        ranges.append(range);
+    }
+}
+
+
+// ***************************************** Constructor, information
+
+ChangedBits::ChangedBits(int size, bool changed)
+{
+    _size = size;
+    _uniform = changed;
+}
+
+int ChangedBits::size() const
+{
+    return _size;
+}
+
+bool ChangedBits::at(int pos) const
+{
+    if (_bits.isEmpty())
+        return _uniform;
+    return bitAt(_bits.constData(), pos);
+}
+
+bool ChangedBits::any() const
+{
+    if (_bits.isEmpty())
+        return _uniform && (_size > 0);
+    const char *src = _bits.constData();
+    for (int idx=0; idx < (_size >> 3); idx++)
+        if (src[idx])
+            return true;
+    for (int pos=(_size & ~7); pos < _size; pos++)   // bits behind _size are not valid
+        if (bitAt(src, pos))
+            return true;
+    return false;
+}
+
+qint64 ChangedBits::memoryUsage() const
+{
+    return _bits.isEmpty() ? 0 : _bits.capacity();
+}
+
+
+// ***************************************** Manipulations
+
+void ChangedBits::set(int pos, bool changed)
+{
+    if (_bits.isEmpty())
+    {
+        if (changed == _uniform)
+            return;
+        expand();
+    }
+    setBit(_bits.data(), pos, changed);
+}
+
+void ChangedBits::fill(int pos, int count, bool changed)
+{
+    if ((pos == 0) && (count >= _size))
+    {
+        _bits.clear();
+        _uniform = changed;
+        return;
+    }
+    if (count <= 0)
+        return;
+    if (_bits.isEmpty())
+    {
+        if (changed == _uniform)
+            return;
+        expand();
+    }
+    fillBits(_bits.data(), pos, count, changed);
+}
+
+void ChangedBits::insert(int pos, int count, bool changed)
+{
+    if (_bits.isEmpty() && ((changed == _uniform) || (_size == 0)))
+    {
+        _uniform = changed;
+        _size += count;
+        return;
+    }
+    ChangedBits bits;
+    bits.append(*this, 0, pos);
+    bits.append(count, changed);
+    bits.append(*this, pos, _size - pos);
+    *this = bits;
+}
+
+void ChangedBits::remove(int pos, int count)
+{
+    count = qMin(count, _size - pos);
+    if (count <= 0)
+        return;
+    if (_bits.isEmpty())
+    {
+        _size -= count;
+        return;
+    }
+    ChangedBits bits;
+    bits.append(*this, 0, pos);
+    bits.append(*this, pos + count, _size - pos - count);
+    *this = bits;
+}
+
+void ChangedBits::truncate(int size)
+{
+    if (size >= _size)
+        return;
+    _size = qMax(size, 0);
+    if (!_bits.isEmpty())
+        _bits.truncate((_size + 7) / 8);
+}
+
+void ChangedBits::append(int count, bool changed)
+{
+    if (count <= 0)
+        return;
+    if (_bits.isEmpty() && ((changed == _uniform) || (_size == 0)))
+    {
+        _uniform = changed;
+        _size += count;
+        return;
+    }
+    expand();
+    _bits.resize((_size + count + 7) / 8);
+    fillBits(_bits.data(), _size, count, changed);
+    _size += count;
+}
+
+void ChangedBits::append(const ChangedBits &bits, int pos, int count)
+{
+    if ((count < 0) || (count > (bits._size - pos)))
+        count = bits._size - pos;
+    if (count <= 0)
+        return;
+    if (bits._bits.isEmpty())
+    {
+        append(count, bits._uniform);
+        return;
+    }
+
+    expand();
+    _bits.resize((_size + count + 7) / 8);
+    char *dst = _bits.data();
+    const char *src = bits._bits.constData();
+
+    // Single bits up to the next byte of the destination, then whole bytes, which
+    // are put together out of two source bytes, when the source is not aligned
+    for (; (count > 0) && (_size & 7); pos++, count--)
+        setBit(dst, _size++, bitAt(src, pos));
+    int shift = pos & 7;
+    for (; count >= 8; pos += 8, count -= 8, _size += 8)
+    {
+        uchar byte = uchar(src[pos >> 3]) >> shift;
+        if (shift)
+            byte |= uchar(src[(pos >> 3) + 1]) << (8 - shift);
+        dst[_size >> 3] = char(byte);
+    }
+    for (; count > 0; pos++, count--)
+        setBit(dst, _size++, bitAt(src, pos));
+}
+
+ChangedBits ChangedBits::mid(int pos, int count) const
+{
+    ChangedBits bits;
+    bits.append(*this, pos, count);
+    return bits;
+}
+
+
+// ***************************************** Conversions
+
+void ChangedBits::copyBytes(char *bytes, int pos, int count) const
+{
+    if (_bits.isEmpty())
+    {
+        memset(bytes, char(_uniform), count);
+        return;
+    }
+    const char *src = _bits.constData();
+    for (int idx=0; idx < count; idx++)
+        bytes[idx] = char(bitAt(src, pos + idx));
+}
+
+void ChangedBits::setBytes(int pos, const char *bytes, int count)
+{
+    for (int idx=0; idx < count; idx++)
+        set(pos + idx, bytes[idx] != 0);
+}
+
+void ChangedBits::appendRanges(ChangedRanges &ranges, qint64 offset, int pos, int count) const
+{
+    if (_bits.isEmpty())
+    {
+        if (_uniform && (count > 0))
+            addRange(ranges, offset + pos, count);
+        return;
+    }
+
+    const char *src = _bits.constData();
+    int end = pos + count;
+    int begin = -1;                             // begin of the current range
+    while (pos < end)
+    {
+        // Unchanged bytes are skipped eight at a time
+        if ((begin < 0) && !(pos & 7) && ((pos + 8) <= end) && (src[pos >> 3] == 0))
+        {
+            pos += 8;
+            continue;
+        }
+        bool changed = bitAt(src, pos);
+        if (changed && (begin < 0))
+            begin = pos;
+        else if (!changed && (begin >= 0))
+        {
+            addRange(ranges, offset + begin, pos - begin);
+            begin = -1;
+        }
+        pos += 1;
+    }
+    if (begin >= 0)
+        addRange(ranges, offset + begin, end - begin);
+}
+
+
+// ***************************************** Private utility functions
+
+void ChangedBits::expand()
+{
+    // Gives a uniform chunk its bits
+    if (_bits.isEmpty() && (_size > 0))
+        _bits = QByteArray((_size + 7) / 8, _uniform ? char(0xff) : char(0));
+}
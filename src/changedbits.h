@@ -0,0 +1,63 @@
+#ifndef CHANGEDBITS_H
+#define CHANGEDBITS_H
+
+/** \cond docNever */
+
+/*! ChangedBits keeps track of the changed bytes of a chunk.
+ *
+ * Every byte of the chunk is represented by one bit, so the bookkeeping costs an
+ * eighth of the data. A chunk, whose bytes are all changed or all unchanged, keeps
+ * no bits at all, only this state. The bits are stored in a QByteArray, copies
+ * share them until one of them is changed.
+ *
+ * Outside of the chunks, changed bytes are described by ChangedRanges: sorted,
+ * not overlapping ranges of changed bytes.
+ */
+
+#include <QtCore>
+
+struct ChangedRange
+{
+    qint64 pos;
+    qint64 size;
+};
+
+typedef QVector<ChangedRange> ChangedRanges;
+
+class ChangedBits
+{
+public:
+    ChangedBits(int size=0, bool changed=false);
+
+    int size() const;
+    bool at(int pos) const;
+    bool any() const;                          // at least one byte is changed
+    qint64 memoryUsage() const;
+
+    // Manipulations like the ones of QByteArray
+    void set(int pos, bool changed);
+    void fill(int pos, int count, bool changed);
+    void insert(int pos, int count, bool changed);
+    void remove(int pos, int count);
+    void truncate(int size);
+    void append(int count, bool changed);
+    void append(const ChangedBits &bits, int pos=0, int count=-1);
+    ChangedBits mid(int pos, int count=-1) const;
+
+    // Conversions to one byte per bit (0 or 1) and to ranges, offset is the
+    // position of the chunk
+    void copyBytes(char *bytes, int pos, int count) const;
+    void setBytes(int pos, const char *bytes, int count);
+    void appendRanges(ChangedRanges &ranges, qint64 offset, int pos, int count) const;
+
+private:
+    void expand();
+
+    QByteArray _bits;                           // empty, if all bits are _uniform
+    int _size;
+    bool _uniform;
+};
+
+/** \endcond docNever */
+
+#endif // CHANGEDBITS_H
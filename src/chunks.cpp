@@ -5,6 +5,7 @@
 #define HIGHLIGHTED 1
 
 #define BUFFER_SIZE 0x10000
+#define COPY_SIZE 0x100000
 #define CHUNK_SIZE 0x1000
 #define READ_CHUNK_MASK Q_INT64_C(0xfffffffffffff000)
 
@@ -12,23 +13,36 @@
 
 Chunks::Chunks(QObject *parent): QObject(parent)
 {
+    init();
     QBuffer *buf = new QBuffer(this);
     setIODevice(*buf);
 }
 
 Chunks::Chunks(QIODevice &ioDevice, QObject *parent): QObject(parent)
 {
+    init();
     setIODevice(ioDevice);
 }
 
+Chunks::~Chunks()
+{
+    releaseIODevice();
+}
+
 bool Chunks::setIODevice(QIODevice &ioDevice)
 {
+    qint64 oldSize = _size;
+    releaseIODevice();
+    _cache.clear();
     _ioDevice = &ioDevice;
     bool ok = _ioDevice->open(QIODevice::ReadOnly);
     if (ok)   // Try to open IODevice
     {
         _size = _ioDevice->size();
-        _ioDevice->close();
+        if (_keepOpen)
+            _openIODevice = _ioDevice;
+        else
+            _ioDevice->close();
     }
     else                                        // Fallback is an empty buffer
     {
@@ -37,24 +51,124 @@ bool Chunks::setIODevice(QIODevice &ioDevice)
         _size = 0;
     }
     _chunks.clear();
+    _newest = 0;
+    _oldest = 0;
+    _spilledSize = 0;
+    _spill.clear();
     _pos = 0;
+    if (_memoryMapped)
+        mapIODevice();
+    changed(0, oldSize, _size);
     return ok;
 }
 
 
+// ***************************************** Access to the source
+
+bool Chunks::setMemoryMapped(bool memoryMapped)
+{
+    releaseIODevice();
+    _memoryMapped = memoryMapped;
+    if (_memoryMapped)
+        mapIODevice();
+    return (_map != 0);
+}
+
+bool Chunks::memoryMapped()
+{
+    return (_map != 0);
+}
+
+void Chunks::setKeepOpen(bool keepOpen)
+{
+    // A mapped file is kept open anyway
+    _keepOpen = keepOpen;
+    if (!_keepOpen && !_map)
+        releaseIODevice();
+}
+
+bool Chunks::keepOpen()
+{
+    return _keepOpen;
+}
+
+void Chunks::setCacheSize(qint64 cacheSize, int blockSize)
+{
+    _cache.clear();
+    if (blockSize > 0)
+        _cacheBlockSize = blockSize;
+    _cache.setMaxCost((int)qMin<qint64>(cacheSize / _cacheBlockSize, INT_MAX));
+    _cacheHits = 0;
+    _cacheMisses = 0;
+}
+
+qint64 Chunks::cacheSize()
+{
+    return (qint64)_cache.maxCost() * _cacheBlockSize;
+}
+
+qint64 Chunks::cacheHits()
+{
+    return _cacheHits;
+}
+
+qint64 Chunks::cacheMisses()
+{
+    return _cacheMisses;
+}
+
+
+// ***************************************** Memory budget of the copied chunks
+
+void Chunks::setMemoryBudget(qint64 memoryBudget)
+{
+    _memoryBudget = qMax<qint64>(memoryBudget, 0);
+    spill();
+}
+
+qint64 Chunks::memoryBudget()
+{
+    return _memoryBudget;
+}
+
+qint64 Chunks::residentSize()
+{
+    return _chunks.size() - _spilledSize;
+}
+
+qint64 Chunks::spilledSize()
+{
+    return _spilledSize;
+}
+
+
 // ***************************************** Getting data out of Chunks
 
 QByteArray Chunks::data(qint64 pos, qint64 maxSize, QByteArray *highlighted)
 {
-    qint64 ioDelta = 0;
-    int chunkIdx = 0;
+    QByteArray buffer = readData(pos, maxSize, highlighted, 0);
+    spill();
+    return buffer;
+}
 
-    Chunk chunk;
+QByteArray Chunks::data(qint64 pos, qint64 maxSize, ChangedRanges *changed)
+{
+    // The changed bytes as ranges cost some bytes per range instead of one per byte
+    QByteArray buffer = readData(pos, maxSize, 0, changed);
+    spill();
+    return buffer;
+}
+
+QByteArray Chunks::readData(qint64 pos, qint64 maxSize, QByteArray *highlighted, ChangedRanges *changed)
+{
+    qint64 ioDelta = 0;
     QByteArray buffer;
 
     // Do some checks and some arrangements
     if (highlighted)
         highlighted->clear();
+    if (changed)
+        changed->clear();
 
     if (pos >= _size)
         return buffer;
@@ -65,84 +179,150 @@ QByteArray Chunks::data(qint64 pos, qint64 maxSize, QByteArray *highlighted)
         if ((pos + maxSize) > _size)
             maxSize = _size - pos;
 
-    _ioDevice->open(QIODevice::ReadOnly);
+    beginRead();
+
+    // The first chunk, which ends behind pos. ioDelta is a difference counter to
+    // justify the read pointer to the original data, if data in between was
+    // deleted or inserted.
+    ChunkNode *node = _chunks.lowerBound(pos, ioDelta);
 
     while (maxSize > 0)
     {
-        chunk.absPos = LLONG_MAX;
-        bool chunksLoopOngoing = true;
-        while ((chunkIdx < _chunks.count()) && chunksLoopOngoing)
-        {
-            // In this section, we track changes before our required data and
-            // we take the editdet data, if availible. ioDelta is a difference
-            // counter to justify the read pointer to the original data, if
-            // data in between was deleted or inserted.
-
-            chunk = _chunks[chunkIdx];
-            if (chunk.absPos > pos)
-                chunksLoopOngoing = false;
-            else
-            {
-                chunkIdx += 1;
-                qint64 count;
-                qint64 chunkOfs = pos - chunk.absPos;
-                if (maxSize > ((qint64)chunk.data.size() - chunkOfs))
-                {
-                    count = (qint64)chunk.data.size() - chunkOfs;
-                    ioDelta += CHUNK_SIZE - chunk.data.size();
-                }
-                else
-                    count = maxSize;
-                if (count > 0)
-                {
-                    buffer += chunk.data.mid(chunkOfs, (int)count);
-                    maxSize -= count;
-                    pos += count;
-                    if (highlighted)
-                        *highlighted += chunk.dataChanged.mid(chunkOfs, (int)count);
-                }
-            }
-        }
+        qint64 chunkPos = LLONG_MAX;
+        if (node)
+            chunkPos = node->chunk.srcPos + ioDelta;
 
-        if ((maxSize > 0) && (pos < chunk.absPos))
+        if (pos < chunkPos)
         {
             // In this section, we read data from the original source. This only will
             // happen, whe no copied data is available
 
             qint64 byteCount;
-            QByteArray readBuffer;
-            if ((chunk.absPos - pos) > maxSize)
+            if ((chunkPos - pos) > maxSize)
                 byteCount = maxSize;
             else
-                byteCount = chunk.absPos - pos;
+                byteCount = chunkPos - pos;
 
-            maxSize -= byteCount;
-            _ioDevice->seek(pos + ioDelta);
-            readBuffer = _ioDevice->read(byteCount);
-            buffer += readBuffer;
+            byteCount = readIODevice(pos - ioDelta, byteCount, buffer);
+            if (byteCount <= 0)
+                break;
             if (highlighted)
-                *highlighted += QByteArray(readBuffer.size(), NORMAL);
-            pos += readBuffer.size();
+                *highlighted += QByteArray((int)byteCount, NORMAL);
+            maxSize -= byteCount;
+            pos += byteCount;
+        }
+        else
+        {
+            // In this section, we take the edited data out of the chunk and step
+            // forward to the next chunk
+
+            if (!touch(node))
+                break;                          // the spill file lost the data
+            Chunk &chunk = node->chunk;
+            qint64 chunkOfs = pos - chunkPos;
+            qint64 count = (qint64)chunk.data.size() - chunkOfs;
+            if (count > maxSize)
+                count = maxSize;
+            if (count > 0)
+            {
+                buffer += chunk.data.mid((int)chunkOfs, (int)count);
+                if (highlighted)
+                {
+                    highlighted->resize(highlighted->size() + (int)count);
+                    chunk.dataChanged.copyBytes(highlighted->data() + highlighted->size() - count,
+                                                (int)chunkOfs, (int)count);
+                }
+                if (changed)
+                    chunk.dataChanged.appendRanges(*changed, chunkPos, (int)chunkOfs, (int)count);
+                maxSize -= count;
+                pos += count;
+            }
+            ioDelta += chunk.data.size() - chunk.srcSize;
+            node = _chunks.next(node);
         }
     }
-    _ioDevice->close();
+    endRead();
     return buffer;
 }
 
 bool Chunks::write(QIODevice &iODevice, qint64 pos, qint64 count)
 {
-    if (count == -1)
-        count = _size;
-    bool ok = iODevice.open(QIODevice::WriteOnly);
-    if (ok)
+    // Writes pos .. pos + count - 1 walking the chunks once. The source data in
+    // between is copied in big sequential blocks, the data of the chunks is written
+    // as it is. Spilled chunks are read out of the spill file without loading them.
+    if ((pos < 0) || (pos > _size))
+        return false;
+    if ((count < 0) || ((pos + count) > _size))
+        count = _size - pos;
+    if (!iODevice.open(QIODevice::WriteOnly))
+        return false;
+
+    qint64 end = pos + count;
+    qint64 ioDelta;
+    bool ok = true;
+    beginRead();
+    ChunkNode *node = _chunks.lowerBound(pos, ioDelta);
+    while (ok && (pos < end))
     {
-        for (qint64 idx=pos; idx < count; idx += BUFFER_SIZE)
+        qint64 chunkPos = node ? (node->chunk.srcPos + ioDelta) : LLONG_MAX;
+        qint64 byteCount;
+        if (pos < chunkPos)
         {
-            QByteArray ba = data(idx, BUFFER_SIZE);
-            iODevice.write(ba);
+            byteCount = qMin<qint64>(qMin(chunkPos, end) - pos, COPY_SIZE);
+            QByteArray buffer;
+            byteCount = readIODevice(pos - ioDelta, byteCount, buffer);
+            ok = (byteCount > 0) && (iODevice.write(buffer) == byteCount);
+        }
+        else
+        {
+            const Chunk &chunk = node->chunk;
+            qint64 chunkOfs = pos - chunkPos;
+            byteCount = qMin<qint64>(chunk.size() - chunkOfs, end - pos);
+            if (chunk.spilled && (byteCount > 0))
+            {
+                QByteArray buffer = _spill->read(chunk.spillPos + chunkOfs, (int)byteCount);
+                ok = (iODevice.write(buffer) == byteCount);
+            }
+            else if (byteCount > 0)
+                ok = (iODevice.write(chunk.data.constData() + chunkOfs, byteCount) == byteCount);
+            ioDelta += chunk.size() - chunk.srcSize;
+            node = _chunks.next(node);
         }
-        iODevice.close();
+        if (byteCount > 0)
+            pos += byteCount;
+    }
+    endRead();
+    iODevice.close();
+    return ok;
+}
+
+bool Chunks::writeChanges(QIODevice &iODevice)
+{
+    // Writes every chunk at its place into a copy of the source, the data in between
+    // is not touched. So no byte may have moved: every chunk has to replace as many
+    // bytes of the source as it holds. Otherwise nothing is written and the whole
+    // data has to be written with write().
+    ChunkNode *node;
+    for (node = _chunks.first(); node; node = _chunks.next(node))
+        if (node->chunk.size() != node->chunk.srcSize)
+            return false;
+    if (!iODevice.open(QIODevice::ReadWrite))
+        return false;
+    bool ok = (iODevice.size() == _size);
+    for (node = _chunks.first(); ok && node; node = _chunks.next(node))
+    {
+        const Chunk &chunk = node->chunk;
+        if (!iODevice.seek(chunk.srcPos))
+            ok = false;
+        else if (chunk.spilled)
+            ok = (iODevice.write(_spill->read(chunk.spillPos, chunk.spillSize)) == chunk.spillSize);
+        else
+            ok = (iODevice.write(chunk.data) == chunk.data.size());
     }
+    iODevice.close();
+
+    // The device may be the source itself, cached blocks are outdated then
+    _cache.clear();
     return ok;
 }
 
@@ -153,9 +333,51 @@ void Chunks::setDataChanged(qint64 pos, bool dataChanged)
 {
     if ((pos < 0) || (pos >= _size))
         return;
-    int chunkIdx = getChunkIndex(pos);
-    qint64 posInBa = pos - _chunks[chunkIdx].absPos;
-    _chunks[chunkIdx].dataChanged[(int)posInBa] = char(dataChanged);
+    qint64 posInBa;
+    ChunkNode *node = getChunkNode(pos, posInBa);
+    if (!node)
+        return;
+    node->chunk.dataChanged.set((int)posInBa, dataChanged);
+    compact(pos, 1);
+    spill();
+}
+
+void Chunks::setDataChanged(qint64 pos, const QByteArray &dataChanged)
+{
+    if ((pos < 0) || ((pos + dataChanged.size()) > _size))
+        return;
+    for (int idx=0; idx < dataChanged.size(); )
+    {
+        qint64 posInBa;
+        ChunkNode *node = getChunkNode(pos + idx, posInBa);
+        if (!node)
+            return;
+        int count = qMin(dataChanged.size() - idx, node->chunk.data.size() - (int)posInBa);
+        if (count <= 0)                         // source was truncated externally
+            return;
+        node->chunk.dataChanged.setBytes((int)posInBa, dataChanged.constData() + idx, count);
+        idx += count;
+    }
+    compact(pos, dataChanged.size());
+    spill();
+}
+
+void Chunks::setDataChanged(qint64 pos, qint64 count, const ChangedRanges &changed)
+{
+    // The bytes in pos .. pos + count - 1 are changed inside of the ranges and
+    // unchanged outside of them
+    if ((pos < 0) || (count < 0) || ((pos + count) > _size))
+        return;
+    fillDataChanged(pos, count, false);
+    for (int idx=0; idx < changed.size(); idx++)
+    {
+        qint64 begin = qMax(changed.at(idx).pos, pos);
+        qint64 end = qMin(changed.at(idx).pos + changed.at(idx).size, pos + count);
+        if (begin < end)
+            fillDataChanged(begin, end - begin, true);
+    }
+    compact(pos, count);
+    spill();
 }
 
 bool Chunks::dataChanged(qint64 pos)
@@ -170,35 +392,100 @@ bool Chunks::dataChanged(qint64 pos)
 
 qint64 Chunks::indexOf(const QByteArray &ba, qint64 from)
 {
-    qint64 result = -1;
-    QByteArray buffer;
-
-    for (qint64 pos=from; (pos < _size) && (result < 0); pos += BUFFER_SIZE)
-    {
-        buffer = data(pos, BUFFER_SIZE + ba.size() - 1);
-        int findPos = buffer.indexOf(ba);
-        if (findPos >= 0)
-            result = pos + (qint64)findPos;
-    }
+    SearchEngine engine(ba);
+    beginRead();
+    qint64 result = engine.indexIn(*this, from, _size);
+    endRead();
     return result;
 }
 
 qint64 Chunks::lastIndexOf(const QByteArray &ba, qint64 from)
 {
-    qint64 result = -1;
-    QByteArray buffer;
+    // The match has to end in front of from
+    SearchEngine engine(ba);
+    beginRead();
+    qint64 result = engine.lastIndexIn(*this, 0, qMin(from, _size));
+    endRead();
+    return result;
+}
+
+qint64 Chunks::indexAll(const QByteArray &ba, MatchIndex &matches, bool overlapping,
+                        qint64 from, qint64 to)
+{
+    // The matches have to be inside of from .. to - 1, to < 0 means the end
+    SearchEngine engine(ba);
+    qint64 count = matches.count();
+    beginRead();
+    engine.indexAll(*this, from, ((to < 0) || (to > _size)) ? _size : to, matches, overlapping);
+    endRead();
+    return matches.count() - count;
+}
+
+ChunksSnapshot Chunks::snapshot(qint64 pos, qint64 maxSize)
+{
+    // The snapshot shares the data of the chunks, QByteArray's copy on write keeps
+    // it unchanged, when Chunks is edited later on. The source is described by its
+    // file name or the data of the QBuffer, so other threads can read it on their own.
+    // Only the pieces reaching into pos .. pos + maxSize - 1 are described, so the
+    // snapshot of a view costs some pieces, not all chunks. Spilled chunks are not
+    // loaded, the snapshot holds the spill file instead.
+
+    ChunksSnapshot snapshot;
+    snapshot.size = _size;
+    snapshot.memoryMapped = (_map != 0);
+    snapshot.valid = true;
+    snapshot.spill = _spill;
+
+    QFile *file = qobject_cast<QFile *>(_ioDevice);
+    QBuffer *buf = qobject_cast<QBuffer *>(_ioDevice);
+    if (file && !file->fileName().isEmpty())
+        snapshot.fileName = file->fileName();
+    else if (buf)
+        snapshot.buffer = buf->data();
+    else
+        snapshot.valid = false;
 
-    for (qint64 pos=from; (pos > 0) && (result < 0); pos -= BUFFER_SIZE)
+    pos = qMax<qint64>(pos, 0);
+    qint64 end = ((maxSize < 0) || ((pos + maxSize) > _size)) ? _size : pos + maxSize;
+    qint64 ioDelta = 0;
+    for (ChunkNode *node = _chunks.lowerBound(pos, ioDelta); node; node = _chunks.next(node))
+    {
+        const Chunk &chunk = node->chunk;
+        qint64 chunkPos = chunk.srcPos + ioDelta;
+        if (chunkPos >= end)
+            break;
+        SnapshotPiece piece;
+        piece.spillPos = -1;
+        if (chunkPos > pos)
+        {
+            piece.pos = pos;
+            piece.size = chunkPos - pos;
+            piece.srcPos = pos - ioDelta;
+            snapshot.pieces.append(piece);
+        }
+        if (chunk.size() > 0)
+        {
+            piece.pos = chunkPos;
+            piece.size = chunk.size();
+            piece.srcPos = -1;
+            piece.spillPos = chunk.spilled ? chunk.spillPos : -1;
+            piece.data = chunk.data;
+            piece.dataChanged = chunk.dataChanged;
+            snapshot.pieces.append(piece);
+        }
+        pos = chunkPos + chunk.size();
+        ioDelta += chunk.size() - chunk.srcSize;
+    }
+    if (end > pos)
     {
-        qint64 sPos = pos - BUFFER_SIZE - (qint64)ba.size() + 1;
-        if (sPos < 0)
-            sPos = 0;
-        buffer = data(sPos, pos - sPos);
-        int findPos = buffer.lastIndexOf(ba);
-        if (findPos >= 0)
-            result = sPos + (qint64)findPos;
+        SnapshotPiece piece;
+        piece.pos = pos;
+        piece.size = end - pos;
+        piece.spillPos = -1;
+        piece.srcPos = pos - ioDelta;
+        snapshot.pieces.append(piece);
     }
-    return result;
+    return snapshot;
 }
 
 
@@ -208,18 +495,25 @@ bool Chunks::insert(qint64 pos, char b)
 {
     if ((pos < 0) || (pos > _size))
         return false;
-    int chunkIdx;
-    if (pos == _size)
-        chunkIdx = getChunkIndex(pos-1);
+    ChunkNode *node;
+    qint64 posInBa;
+    if ((pos == _size) && (pos > 0))
+    {
+        node = getChunkNode(pos-1, posInBa);
+        posInBa += 1;
+    }
     else
-        chunkIdx = getChunkIndex(pos);
-    qint64 posInBa = pos - _chunks[chunkIdx].absPos;
-    _chunks[chunkIdx].data.insert(posInBa, b);
-    _chunks[chunkIdx].dataChanged.insert(posInBa, char(1));
-    for (int idx=chunkIdx+1; idx < _chunks.size(); idx++)
-        _chunks[idx].absPos += 1;
+        node = getChunkNode(pos, posInBa);
+    if (!node)
+        return false;
+    node->chunk.data.insert((int)posInBa, b);
+    node->chunk.dataChanged.insert((int)posInBa, 1, true);
+    _chunks.update(node);
     _size += 1;
     _pos = pos;
+    changed(pos, 0, 1);
+    compact(pos, 1);
+    spill();
     return true;
 }
 
@@ -227,11 +521,16 @@ bool Chunks::overwrite(qint64 pos, char b)
 {
     if ((pos < 0) || (pos >= _size))
         return false;
-    int chunkIdx = getChunkIndex(pos);
-    qint64 posInBa = pos - _chunks[chunkIdx].absPos;
-    _chunks[chunkIdx].data[(int)posInBa] = b;
-    _chunks[chunkIdx].dataChanged[(int)posInBa] = char(1);
+    qint64 posInBa;
+    ChunkNode *node = getChunkNode(pos, posInBa);
+    if (!node)
+        return false;
+    node->chunk.data[(int)posInBa] = b;
+    node->chunk.dataChanged.set((int)posInBa, true);
     _pos = pos;
+    changed(pos, 1, 1);
+    compact(pos, 1);
+    spill();
     return true;
 }
 
@@ -239,14 +538,324 @@ bool Chunks::removeAt(qint64 pos)
 {
     if ((pos < 0) || (pos >= _size))
         return false;
-    int chunkIdx = getChunkIndex(pos);
-    qint64 posInBa = pos - _chunks[chunkIdx].absPos;
-    _chunks[chunkIdx].data.remove(posInBa, 1);
-    _chunks[chunkIdx].dataChanged.remove(posInBa, 1);
-    for (int idx=chunkIdx+1; idx < _chunks.size(); idx++)
-        _chunks[idx].absPos -= 1;
+    qint64 posInBa;
+    ChunkNode *node = getChunkNode(pos, posInBa);
+    if (!node)
+        return false;
+    node->chunk.data.remove((int)posInBa, 1);
+    node->chunk.dataChanged.remove((int)posInBa, 1);
+    _chunks.update(node);
     _size -= 1;
     _pos = pos;
+    changed(pos, 1, 0);
+    compact(pos, 0);
+    spill();
+    return true;
+}
+
+
+// ***************************************** ByteArray manipulations
+
+bool Chunks::insert(qint64 pos, const QByteArray &ba)
+{
+    if ((pos < 0) || (pos > _size))
+        return false;
+    if (ba.size() == 0)
+        return true;
+    ChunkNode *node;
+    qint64 posInBa;
+    if ((pos == _size) && (pos > 0))
+    {
+        node = getChunkNode(pos-1, posInBa);
+        posInBa += 1;
+    }
+    else
+        node = getChunkNode(pos, posInBa);
+    if (!node)
+        return false;
+
+    Chunk &chunk = node->chunk;
+    if ((chunk.data.size() + ba.size()) <= 2 * CHUNK_SIZE)
+    {
+        chunk.data.insert((int)posInBa, ba);
+        chunk.dataChanged.insert((int)posInBa, ba.size(), true);
+        _chunks.update(node);
+    }
+    else
+    {
+        // Split the chunk at posInBa and splice the new data in as chunks of
+        // CHUNK_SIZE bytes. The new chunks replace no source data, they all sit
+        // at the source position behind the split chunk.
+        Chunk tail;
+        tail.data = chunk.data.mid((int)posInBa);
+        tail.dataChanged = chunk.dataChanged.mid((int)posInBa);
+        tail.srcPos = chunk.srcPos + chunk.srcSize;
+        tail.srcSize = 0;
+        chunk.data.truncate((int)posInBa);
+        chunk.dataChanged.truncate((int)posInBa);
+        _chunks.update(node);
+
+        ChunkNode *nextNode = _chunks.next(node);
+        for (int idx=0; idx < ba.size(); idx += CHUNK_SIZE)
+        {
+            Chunk newChunk;
+            newChunk.data = ba.mid(idx, CHUNK_SIZE);
+            newChunk.dataChanged = ChangedBits(newChunk.data.size(), true);
+            newChunk.srcPos = tail.srcPos;
+            newChunk.srcSize = 0;
+            insertChunk(nextNode, newChunk);
+        }
+        if (tail.data.size() > 0)
+            insertChunk(nextNode, tail);
+    }
+    _size += ba.size();
+    _pos = pos;
+    changed(pos, 0, ba.size());
+    compact(pos, ba.size());
+    spill();
+    return true;
+}
+
+bool Chunks::overwrite(qint64 pos, const QByteArray &ba)
+{
+    if ((pos < 0) || ((pos + ba.size()) > _size))
+        return false;
+    for (int idx=0; idx < ba.size(); )
+    {
+        qint64 ioDelta;
+        ChunkNode *node = _chunks.lowerBound(pos + idx, ioDelta);
+        qint64 chunkPos = node ? (node->chunk.srcPos + ioDelta) : LLONG_MAX;
+        qint64 readPos = pos + idx - ioDelta;
+
+        if (((readPos & ~READ_CHUNK_MASK) == 0) && ((pos + idx + CHUNK_SIZE) <= chunkPos)
+                && ((idx + CHUNK_SIZE) <= ba.size()))
+        {
+            // A whole block of the source is overwritten, so there is no need to read it
+            Chunk newChunk;
+            newChunk.data = ba.mid(idx, CHUNK_SIZE);
+            newChunk.dataChanged = ChangedBits(CHUNK_SIZE, true);
+            newChunk.srcPos = readPos;
+            newChunk.srcSize = CHUNK_SIZE;
+            insertChunk(node, newChunk);
+            idx += CHUNK_SIZE;
+            continue;
+        }
+
+        qint64 posInBa;
+        node = getChunkNode(pos + idx, posInBa);
+        if (!node)
+            return false;
+        int count = qMin(ba.size() - idx, node->chunk.data.size() - (int)posInBa);
+        if (count <= 0)                         // source was truncated externally
+            return false;
+        node->chunk.data.replace((int)posInBa, count, ba.mid(idx, count));
+        node->chunk.dataChanged.fill((int)posInBa, count, true);
+        idx += count;
+    }
+    _pos = pos;
+    changed(pos, ba.size(), ba.size());
+    compact(pos, ba.size());
+    spill();
+    return true;
+}
+
+bool Chunks::remove(qint64 pos, qint64 len)
+{
+    if ((pos < 0) || (len < 0) || ((pos + len) > _size))
+        return false;
+    qint64 removed = len;
+    while (len > 0)
+    {
+        // After removing, the following data moves to pos
+        qint64 ioDelta;
+        ChunkNode *node = _chunks.lowerBound(pos, ioDelta);
+        qint64 chunkPos = node ? (node->chunk.srcPos + ioDelta) : LLONG_MAX;
+        qint64 readPos = pos - ioDelta;
+
+        if (((readPos & ~READ_CHUNK_MASK) == 0) && ((pos + CHUNK_SIZE) <= chunkPos)
+                && (len >= CHUNK_SIZE))
+        {
+            // Whole blocks of the source are removed. They are replaced by one empty
+            // chunk without reading them.
+            qint64 count = qMin(len, chunkPos - pos) & READ_CHUNK_MASK;
+            Chunk newChunk;
+            newChunk.srcPos = readPos;
+            newChunk.srcSize = count;
+            insertChunk(node, newChunk);
+            _size -= count;
+            len -= count;
+            continue;
+        }
+
+        qint64 posInBa;
+        node = getChunkNode(pos, posInBa);
+        if (!node)
+            return false;
+        int count = (int)qMin<qint64>(len, node->chunk.data.size() - posInBa);
+        if (count <= 0)                         // source was truncated externally
+            return false;
+        node->chunk.data.remove((int)posInBa, count);
+        node->chunk.dataChanged.remove((int)posInBa, count);
+        _chunks.update(node);
+        _size -= count;
+        len -= count;
+    }
+    _pos = pos;
+    changed(pos, removed, 0);
+    compact(pos, 0);
+    spill();
+    return true;
+}
+
+bool Chunks::replaceAll(const MatchIndex &positions, int len, const QByteArray &ba,
+                        const QByteArray &dataChanged, QByteArray *oldDataChanged)
+{
+    // Replaces len bytes at every position with ba. The positions have to be in
+    // ascending order without overlapping. Every chunk is rebuilt once for all
+    // positions inside of it, the source data in between is not touched.
+    // dataChanged holds the highlighting of ba for every position one after the
+    // other, empty means changed. oldDataChanged gets the replaced highlighting.
+    if (positions.count() == 0)
+        return true;
+    qint64 first = positions.block(0).first();
+    qint64 last = positions.previous(LLONG_MAX);
+    if ((len < 0) || (first < 0) || ((last + len) > _size))
+        return false;
+
+    // All chunks are read with one opening of the device
+    qint64 size = _size;
+    beginRead();
+    _replacing = true;
+    bool result = replaceChunks(positions, len, ba, dataChanged, oldDataChanged);
+    _replacing = false;
+    changed(first, last + len - first, last + len + _size - size - first);
+    compact(first, last + len + _size - size - first);
+    endRead();
+    spill();
+    return result;
+}
+
+bool Chunks::replaceChunks(const MatchIndex &positions, int len, const QByteArray &ba,
+                           const QByteArray &dataChanged, QByteArray *oldDataChanged)
+{
+    qint64 first = positions.block(0).first();
+    qint64 changedIdx = 0;                      // highlighting of ba in dataChanged
+    qint64 shift = 0;                           // size difference of the positions done
+    QVector<qint64> found = positions.block(0);
+    int block = 0;
+    int idx = 0;
+
+    if (len == 0)
+    {
+        // Nothing to rebuild, the positions may also lie at the end of the data
+        for (block=0; block < positions.blockCount(); block++)
+        {
+            found = positions.block(block);
+            for (idx=0; idx < found.size(); idx++)
+            {
+                insert(found.at(idx) + shift, ba);
+                if (!dataChanged.isEmpty())
+                    setDataChanged(found.at(idx) + shift, dataChanged.mid((int)changedIdx, ba.size()));
+                changedIdx += ba.size();
+                shift += ba.size();
+            }
+        }
+        _pos = first;
+        return true;
+    }
+
+    while (idx < found.size())
+    {
+        qint64 posInBa;
+        ChunkNode *node = getChunkNode(found.at(idx) + shift, posInBa);
+        if (!node)
+            return false;
+        Chunk &chunk = node->chunk;
+        if (posInBa >= chunk.data.size())       // source was truncated externally
+            return false;
+
+        // Offsets inside of the chunk refer to its data before the rebuild
+        qint64 chunkPos = found.at(idx) + shift - posInBa;
+        qint64 chunkShift = shift;
+        QByteArray newData;
+        ChangedBits newChanged;
+        newData.reserve(chunk.data.size() + qMax(ba.size() - len, 0));
+        int copied = 0;
+        int overhang = 0;                       // bytes to replace behind the chunk
+        while ((idx < found.size()) && ((found.at(idx) + chunkShift - chunkPos) < chunk.data.size()))
+        {
+            int offset = (int)(found.at(idx) + chunkShift - chunkPos);
+            int end = qMin(offset + len, chunk.data.size());
+            newData.append(chunk.data.constData() + copied, offset - copied);
+            newChanged.append(chunk.dataChanged, copied, offset - copied);
+            newData.append(ba);
+            newChanged.append(ba.size(), true);
+            if (!dataChanged.isEmpty())
+                newChanged.setBytes(newChanged.size() - ba.size(), dataChanged.constData() + changedIdx, ba.size());
+            if (oldDataChanged)
+            {
+                oldDataChanged->resize(oldDataChanged->size() + end - offset);
+                chunk.dataChanged.copyBytes(oldDataChanged->data() + oldDataChanged->size() - (end - offset),
+                                            offset, end - offset);
+            }
+            changedIdx += ba.size();
+            shift += ba.size() - len;
+            overhang = offset + len - end;
+            copied = end;
+
+            idx += 1;
+            if ((idx == found.size()) && ((block + 1) < positions.blockCount()))
+            {
+                found = positions.block(++block);
+                idx = 0;
+            }
+            if (overhang > 0)
+                break;
+        }
+        newData.append(chunk.data.constData() + copied, chunk.data.size() - copied);
+        newChanged.append(chunk.dataChanged, copied);
+        _size += newData.size() - chunk.data.size();
+
+        if (newData.size() <= 2 * CHUNK_SIZE)
+        {
+            chunk.data = newData;
+            chunk.dataChanged = newChanged;
+            _chunks.update(node);
+        }
+        else
+        {
+            // Like insert(), the surplus follows as chunks, which replace no source data
+            qint64 srcEnd = chunk.srcPos + chunk.srcSize;
+            chunk.data = newData.left(CHUNK_SIZE);
+            chunk.dataChanged = newChanged.mid(0, CHUNK_SIZE);
+            _chunks.update(node);
+            ChunkNode *nextNode = _chunks.next(node);
+            for (int pos=CHUNK_SIZE; pos < newData.size(); pos += CHUNK_SIZE)
+            {
+                Chunk newChunk;
+                newChunk.data = newData.mid(pos, CHUNK_SIZE);
+                newChunk.dataChanged = newChanged.mid(pos, CHUNK_SIZE);
+                newChunk.srcPos = srcEnd;
+                newChunk.srcSize = 0;
+                insertChunk(nextNode, newChunk);
+            }
+        }
+
+        // A replacement reaching into the following data ends with removing it
+        if (overhang > 0)
+        {
+            qint64 removePos = chunkPos + newData.size();
+            if (oldDataChanged)
+            {
+                QByteArray removedChanged;
+                readData(removePos, overhang, &removedChanged, 0);
+                oldDataChanged->append(removedChanged);
+            }
+            if (!remove(removePos, overhang))
+                return false;
+        }
+    }
+    _pos = first;
     return true;
 }
 
@@ -268,56 +877,589 @@ qint64 Chunks::size()
     return _size;
 }
 
-int Chunks::getChunkIndex(qint64 absPos)
+ChunkNode *Chunks::getChunkNode(qint64 absPos, qint64 &posInBa)
 {
-    // This routine checks, if there is already a copied chunk available. If os, it
-    // returns a reference to it. If there is no copied chunk available, original
-    // data will be copied into a new chunk.
+    // This routine checks, if there is already a copied chunk available. If so, it
+    // returns it. If there is no copied chunk available, original data will be
+    // copied into a new chunk. posInBa is the position of absPos inside the chunk.
+    // The caller changes the chunk, so a copy in the spill file is outdated. Gives
+    // back 0, if the chunk is spilled and the spill file lost its data.
 
-    int foundIdx = -1;
-    int insertIdx = 0;
-    qint64 ioDelta = 0;
+    qint64 ioDelta;
+    ChunkNode *node = _chunks.lowerBound(absPos, ioDelta);
 
+    if (node && ((node->chunk.srcPos + ioDelta) <= absPos))
+    {
+        if (!touch(node))
+            return 0;
+        dropSpillCopy(node);
+        posInBa = absPos - (node->chunk.srcPos + ioDelta);
+        return node;
+    }
+
+    Chunk newChunk;
+    qint64 readAbsPos = absPos - ioDelta;
+    qint64 readPos = (readAbsPos & READ_CHUNK_MASK);
+    beginRead();
+    if (readAbsPos >= _ioDevice->size())        // behind the end of the source
+        readPos = _ioDevice->size();
+    readIODevice(readPos, CHUNK_SIZE, newChunk.data);
+    endRead();
+    newChunk.srcPos = readPos;
+    newChunk.srcSize = newChunk.data.size();
+    newChunk.dataChanged = ChangedBits(newChunk.data.size(), false);
+    posInBa = readAbsPos - readPos;
+    return insertChunk(node, newChunk);
+}
+
+// ***************************************** Changes of the contents
+
+void ContentsChange::merge(qint64 changePos, qint64 changeRemoved, qint64 changeAdded)
+{
+    // The range covers both changes. The following change refers to the data after
+    // this one, bytes beside this change move one to one.
+    if (pos < 0)
+    {
+        pos = changePos;
+        removed = changeRemoved;
+        added = changeAdded;
+        return;
+    }
+    qint64 end = pos + added;
+    qint64 changeEnd = changePos + changeRemoved;
+    qint64 begin = qMin(pos, changePos);
+    removed += (pos - begin) + qMax<qint64>(changeEnd - end, 0);
+    added = qMax(end, changeEnd) - begin + changeAdded - changeRemoved;
+    pos = begin;
+}
+
+void Chunks::changed(qint64 pos, qint64 removed, qint64 added)
+{
+    if (!_replacing)
+        emit contentsChanged(pos, removed, added);
+}
+
+
+// ***************************************** Keeping the chunks at about CHUNK_SIZE
+
+void Chunks::compact(qint64 pos, qint64 count)
+{
+    // Edits leave chunks of any size behind. The chunks in pos .. pos + count and
+    // their neighbours are brought back to about CHUNK_SIZE: oversized chunks are
+    // split, small neighbours are merged with the source data in between and chunks,
+    // which equal their source again, are dropped. Every edit only pays for the
+    // chunks it touched.
+    qint64 ioDelta;
+    ChunkNode *node = _chunks.lowerBound(qMax<qint64>(pos - 1, 0), ioDelta);
+    ChunkNode *prev = node ? _chunks.prev(node) : _chunks.last();
+    if (prev)
+    {
+        node = prev;
+        ioDelta -= node->chunk.size() - node->chunk.srcSize;
+    }
 
-    for (int idx=0; idx < _chunks.size(); idx++)
+    beginRead();
+    while (node && ((node->chunk.srcPos + ioDelta) <= (pos + count)))
     {
-        Chunk chunk = _chunks[idx];
-        if ((absPos >= chunk.absPos) && (absPos < (chunk.absPos + chunk.data.size())))
+        ChunkNode *next = _chunks.next(node);
+        if (equalsSource(node))
         {
-            foundIdx = idx;
-            break;
+            removeChunk(node);                  // the delta of the chunk was 0
+            node = next;
+            continue;
         }
-        if (absPos < chunk.absPos)
+        if (node->chunk.size() > 2 * CHUNK_SIZE)
+            splitChunk(node);
+        else if (next && mergeChunks(node, next))
+            continue;                           // maybe the following one fits too
+        ioDelta += node->chunk.size() - node->chunk.srcSize;
+        node = _chunks.next(node);
+    }
+    endRead();
+}
+
+bool Chunks::equalsSource(ChunkNode *node)
+{
+    // Changed bytes are never dropped, even if they equal the source
+    Chunk &chunk = node->chunk;
+    if ((chunk.size() == 0) && (chunk.srcSize == 0))
+        return true;
+    if ((chunk.size() != chunk.srcSize) || chunk.dataChanged.any() || !touch(node))
+        return false;
+    QByteArray source;
+    return (readIODevice(chunk.srcPos, chunk.srcSize, source) == chunk.srcSize)
+            && (source == chunk.data);
+}
+
+bool Chunks::mergeChunks(ChunkNode *node, ChunkNode *next)
+{
+    // Appends next and the source data between both to node, if all fit into one
+    // chunk. The source in between is a few aligned blocks at most.
+    Chunk &chunk = node->chunk;
+    qint64 srcEnd = chunk.srcPos + chunk.srcSize;
+    qint64 gap = next->chunk.srcPos - srcEnd;
+    if ((gap < 0) || ((chunk.size() + gap + next->chunk.size()) > CHUNK_SIZE))
+        return false;
+    QByteArray source;
+    if (readIODevice(srcEnd, gap, source) != gap)
+        return false;                           // source was truncated externally
+    if (!touch(next) || !touch(node))
+        return false;
+
+    dropSpillCopy(node);
+    chunk.data += source;
+    chunk.data += next->chunk.data;
+    chunk.dataChanged.append((int)gap, false);
+    chunk.dataChanged.append(next->chunk.dataChanged);
+    chunk.srcSize = next->chunk.srcPos + next->chunk.srcSize - chunk.srcPos;
+    removeChunk(next);
+    _chunks.update(node);
+    return true;
+}
+
+void Chunks::splitChunk(ChunkNode *node)
+{
+    // node keeps the first CHUNK_SIZE bytes and the replaced source data, like in
+    // insert() the rest follows as chunks, which replace no source data
+    if (!touch(node))
+        return;
+    dropSpillCopy(node);
+    Chunk &chunk = node->chunk;
+    qint64 srcEnd = chunk.srcPos + chunk.srcSize;
+    ChunkNode *nextNode = _chunks.next(node);
+    for (int pos=CHUNK_SIZE; pos < chunk.data.size(); pos += CHUNK_SIZE)
+    {
+        Chunk newChunk;
+        newChunk.data = chunk.data.mid(pos, CHUNK_SIZE);
+        newChunk.dataChanged = chunk.dataChanged.mid(pos, CHUNK_SIZE);
+        newChunk.srcPos = srcEnd;
+        newChunk.srcSize = 0;
+        insertChunk(nextNode, newChunk);
+    }
+    chunk.data.truncate(CHUNK_SIZE);
+    chunk.dataChanged.truncate(CHUNK_SIZE);
+    _chunks.update(node);
+}
+
+// ***************************************** Chunks in memory and in the spill file
+
+ChunkNode *Chunks::insertChunk(ChunkNode *node, const Chunk &chunk)
+{
+    // New chunks are in memory and the most recently used ones
+    ChunkNode *newNode = _chunks.insertBefore(node, chunk);
+    touch(newNode);
+    return newNode;
+}
+
+bool Chunks::touch(ChunkNode *node)
+{
+    // Loads the data of a spilled chunk and moves the chunk to the front of the
+    // list of the chunks in memory. If the spill file can not give back the data
+    // (I/O error, truncated file), the chunk stays spilled and false is returned,
+    // so reads end short and edits and writes fail instead of using zeros.
+    Chunk &chunk = node->chunk;
+    if (chunk.spilled)
+    {
+        QByteArray data = _spill->read(chunk.spillPos, chunk.spillSize);
+        if (data.size() != chunk.spillSize)
+            return false;
+        chunk.data = data;
+        chunk.spilled = false;
+        _spilledSize -= chunk.spillSize;
+    }
+    else if (node == _newest)
+        return true;
+    else
+        unlink(node);
+
+    node->older = _newest;
+    node->newer = 0;
+    if (_newest)
+        _newest->newer = node;
+    else
+        _oldest = node;
+    _newest = node;
+    return true;
+}
+
+void Chunks::unlink(ChunkNode *node)
+{
+    // Empty chunks leave the list without being spilled, they are not in it any more
+    if (!node->newer && (node != _newest))
+        return;
+    if (node->newer)
+        node->newer->older = node->older;
+    else
+        _newest = node->older;
+    if (node->older)
+        node->older->newer = node->newer;
+    else
+        _oldest = node->newer;
+    node->older = 0;
+    node->newer = 0;
+}
+
+void Chunks::removeChunk(ChunkNode *node)
+{
+    if (node->chunk.spilled)
+        _spilledSize -= node->chunk.spillSize;
+    unlink(node);
+    dropSpillCopy(node);
+    _chunks.remove(node);
+}
+
+void Chunks::dropSpillCopy(ChunkNode *node)
+{
+    // The copy in the spill file is outdated, when the chunk changes
+    if (node->chunk.spillPos >= 0)
+    {
+        _spill->release(node->chunk.spillSize);
+        node->chunk.spillPos = -1;
+    }
+}
+
+void Chunks::spill()
+{
+    // The least recently used chunks leave memory, until three quarters of the budget
+    // are left, so the next edits do not spill again at once. Chunks, which did not
+    // change since they were loaded, keep their old place in the spill file. The
+    // newest chunk stays, callers may still use its data.
+    if ((_memoryBudget == 0) || (residentSize() <= _memoryBudget))
+        return;
+    if (!_spill)
+        _spill = QSharedPointer<ChunkSpill>(new ChunkSpill());
+    else if ((_spill->garbage() > (_spill->size() / 2)) && (_spill->garbage() > _memoryBudget))
+        compactSpill();
+    if (!_spill->isOpen())
+        return;                                 // no spill file, everything stays
+
+    qint64 target = _memoryBudget * 3 / 4;
+    while ((residentSize() > target) && _oldest && (_oldest != _newest))
+    {
+        ChunkNode *node = _oldest;
+        Chunk &chunk = node->chunk;
+        if (chunk.data.isEmpty())
         {
-            insertIdx = idx;
-            break;
+            unlink(node);
+            continue;
         }
-        ioDelta += chunk.data.size() - CHUNK_SIZE;
-        insertIdx = idx + 1;
+        if (chunk.spillPos < 0)
+            chunk.spillPos = _spill->write(chunk.data);
+        if (chunk.spillPos < 0)
+            return;
+        unlink(node);
+        chunk.spillSize = chunk.data.size();
+        chunk.spilled = true;
+        chunk.data = QByteArray();
+        _spilledSize += chunk.spillSize;
     }
+}
+
+void Chunks::compactSpill()
+{
+    // The spilled chunks move to a new spill file, snapshots keep the old one
+    QSharedPointer<ChunkSpill> spill(new ChunkSpill());
+    QVector<qint64> positions;
+    ChunkNode *node;
+    for (node = _chunks.first(); node; node = _chunks.next(node))
+        if (node->chunk.spilled)
+        {
+            positions.append(spill->write(_spill->read(node->chunk.spillPos, node->chunk.spillSize)));
+            if (positions.last() < 0)
+                return;
+        }
 
-    if (foundIdx == -1)
+    int idx = 0;
+    for (node = _chunks.first(); node; node = _chunks.next(node))
+        node->chunk.spillPos = node->chunk.spilled ? positions.at(idx++) : -1;
+    _spill = spill;
+}
+
+void Chunks::fillDataChanged(qint64 pos, qint64 count, bool changed)
+{
+    // Source data is unchanged anyway, so only changed bytes copy it into chunks
+    while (count > 0)
     {
-        Chunk newChunk;
-        qint64 readAbsPos = absPos - ioDelta;
-        qint64 readPos = (readAbsPos & READ_CHUNK_MASK);
-        _ioDevice->open(QIODevice::ReadOnly);
-        _ioDevice->seek(readPos);
-        newChunk.data = _ioDevice->read(CHUNK_SIZE);
+        qint64 ioDelta;
+        ChunkNode *node = _chunks.lowerBound(pos, ioDelta);
+        qint64 chunkPos = node ? (node->chunk.srcPos + ioDelta) : LLONG_MAX;
+        if (!changed && (pos < chunkPos))
+        {
+            qint64 skip = qMin(count, chunkPos - pos);
+            pos += skip;
+            count -= skip;
+            continue;
+        }
+        qint64 posInBa;
+        node = getChunkNode(pos, posInBa);
+        if (!node)
+            return;
+        int fill = (int)qMin<qint64>(count, node->chunk.data.size() - posInBa);
+        if (fill <= 0)                          // source was truncated externally
+            return;
+        node->chunk.dataChanged.fill((int)posInBa, fill, changed);
+        pos += fill;
+        count -= fill;
+    }
+}
+
+void Chunks::init()
+{
+    _map = 0;
+    _mapSize = 0;
+    _memoryMapped = false;
+    _keepOpen = false;
+    _cacheBlockSize = 0x10000;
+    _cacheHits = 0;
+    _cacheMisses = 0;
+    _readDepth = 0;
+    _replacing = false;
+    _size = 0;
+    _cache.setMaxCost(0);
+    _memoryBudget = 0;
+    _spilledSize = 0;
+    _newest = 0;
+    _oldest = 0;
+}
+
+void Chunks::beginRead()
+{
+    // Call this before reading from the source. The device itself is opened by
+    // readIODevice(), when the data is neither mapped nor cached. Calls may be
+    // nested, the device is closed by the outermost endRead().
+    _readDepth += 1;
+    if (_map && _openIODevice)
+    {
+        // Another application may have truncated or extended the file. Touching the
+        // mapping behind the end of the file is fatal (SIGBUS), so we map again
+        // whenever the size has changed. A truncation between this check and the
+        // copy is not caught, reading the last page with read() would not help
+        // either, as the file may shrink by any number of pages. This is accepted,
+        // setMemoryMapped() of QHexEdit tells about it.
+        QFile *file = static_cast<QFile *>(_openIODevice.data());
+        if (file->size() != _mapSize)
+        {
+            releaseIODevice();
+            mapIODevice();
+        }
+    }
+    else if (_map)
+        _map = 0;
+}
+
+void Chunks::endRead()
+{
+    // Closes the device, so external applications can overwrite the file
+    _readDepth -= 1;
+    if ((_readDepth == 0) && !_openIODevice && _ioDevice->isOpen())
         _ioDevice->close();
-        newChunk.absPos = absPos - (readAbsPos - readPos);
-        newChunk.dataChanged = QByteArray(newChunk.data.size(), char(0));
-        _chunks.insert(insertIdx, newChunk);
-        foundIdx = insertIdx;
+}
+
+qint64 Chunks::readIODevice(qint64 pos, qint64 maxSize, QByteArray &buffer)
+{
+    // Appends up to maxSize bytes of the source starting at pos to buffer. Mapped
+    // data is copied once without any system call. With a cache, the source is
+    // read in aligned blocks, which are kept in a LRU cache.
+
+    if (_map && (pos < _mapSize))
+    {
+        if ((pos + maxSize) > _mapSize)
+            maxSize = _mapSize - pos;
+        buffer.append((const char *)_map + pos, (int)maxSize);
+        return maxSize;
+    }
+
+    if (_cache.maxCost() == 0)
+    {
+        if (!openIODevice())
+            return 0;
+        _ioDevice->seek(pos);
+        QByteArray readBuffer = _ioDevice->read(maxSize);
+        buffer += readBuffer;
+        return readBuffer.size();
+    }
+
+    qint64 count = 0;
+    while (maxSize > 0)
+    {
+        qint64 blockPos = pos - (pos % _cacheBlockSize);
+        QByteArray block;
+        QByteArray *cached = _cache.object(blockPos);
+        if (cached)
+        {
+            _cacheHits += 1;
+            block = *cached;
+        }
+        else
+        {
+            // Only a miss opens the device
+            if (!openIODevice())
+                break;
+            _cacheMisses += 1;
+            _ioDevice->seek(blockPos);
+            block = _ioDevice->read(_cacheBlockSize);
+            _cache.insert(blockPos, new QByteArray(block), 1);
+        }
+
+        qint64 blockOfs = pos - blockPos;
+        qint64 byteCount = qMin<qint64>(block.size() - blockOfs, maxSize);
+        if (byteCount <= 0)
+            break;
+        buffer.append(block.constData() + blockOfs, (int)byteCount);
+        count += byteCount;
+        pos += byteCount;
+        maxSize -= byteCount;
+    }
+    return count;
+}
+
+bool Chunks::openIODevice()
+{
+    if (_ioDevice->isOpen())
+        return true;
+    if (!_ioDevice->open(QIODevice::ReadOnly))
+        return false;
+    if (_keepOpen)
+        _openIODevice = _ioDevice;
+    return true;
+}
+
+qint64 Chunks::readSegment(qint64 pos, qint64 maxSize, bool backward, const char *&segment, QByteArray &buffer)
+{
+    // Gives back the size of the next piece of data, which starts at pos or ends
+    // at pos when going backward. Copied chunks and mapped data are not copied,
+    // segment points right into them. Other source data is read into buffer.
+
+    qint64 ioDelta = 0;
+    qint64 lookup = backward ? pos - 1 : pos;
+    ChunkNode *node = _chunks.lowerBound(lookup, ioDelta);
+
+    qint64 chunkPos = LLONG_MAX;
+    if (node)
+        chunkPos = node->chunk.srcPos + ioDelta;
+
+    qint64 start, end;
+    if (lookup >= chunkPos)
+    {
+        // Inside of a copied chunk, which stays in memory as the newest one
+        if (!touch(node))
+            return 0;
+        spill();
+        if (backward)
+        {
+            start = qMax(chunkPos, pos - maxSize);
+            end = pos;
+        }
+        else
+        {
+            start = pos;
+            end = qMin(chunkPos + node->chunk.data.size(), pos + maxSize);
+        }
+        segment = node->chunk.data.constData() + (start - chunkPos);
+        return end - start;
+    }
+
+    // The gap in front of the chunk is source data
+    if (backward)
+    {
+        ChunkNode *prevNode = node ? _chunks.prev(node) : _chunks.last();
+        start = prevNode ? prevNode->chunk.srcPos + prevNode->chunk.srcSize + ioDelta : 0;
+        start = qMax(start, pos - maxSize);
+        end = pos;
+    }
+    else
+    {
+        start = pos;
+        end = qMin(qMin(chunkPos, _size), pos + maxSize);
+    }
+
+    if (_map && ((start - ioDelta) < _mapSize))
+    {
+        qint64 mapEnd = _mapSize + ioDelta;
+        if (end > mapEnd)
+        {
+            if (backward)
+                return 0;                       // source was truncated externally
+            end = mapEnd;
+        }
+        segment = (const char *)_map + (start - ioDelta);
+        return end - start;
+    }
+
+    if ((end - start) > BUFFER_SIZE)
+    {
+        if (backward)
+            start = end - BUFFER_SIZE;
+        else
+            end = start + BUFFER_SIZE;
+    }
+    buffer.clear();
+    qint64 count = readIODevice(start - ioDelta, end - start, buffer);
+    if (backward && (count < (end - start)))
+        return 0;
+    segment = buffer.constData();
+    return count;
+}
+
+void Chunks::mapIODevice()
+{
+    // Only QFile supports memory mapping, all other devices keep using the open,
+    // seek, read and close path. The file stays open as long as it is mapped.
+    QFile *file = qobject_cast<QFile *>(_ioDevice);
+    if (!file || (!file->isOpen() && !file->open(QIODevice::ReadOnly)))
+        return;
+    _openIODevice = file;
+    _mapSize = file->size();
+    if (_mapSize > 0)
+        _map = file->map(0, _mapSize);
+    if (!_map)
+    {
+        _mapSize = 0;
+        if (!_keepOpen)
+            releaseIODevice();
+    }
+}
+
+void Chunks::releaseIODevice()
+{
+    // Unmaps and closes the device, if Chunks keeps it open
+    if (_openIODevice)
+    {
+        if (_map)
+            static_cast<QFile *>(_openIODevice.data())->unmap(_map);
+        _openIODevice->close();
     }
-    return foundIdx;
+    _openIODevice = 0;
+    _map = 0;
+    _mapSize = 0;
 }
 
 
 #ifdef MODUL_TEST
 int Chunks::chunkSize()
 {
-    return _chunks.size();
+    return _chunks.count();
+}
+
+int Chunks::maxChunkSize()
+{
+    int size = 0;
+    for (ChunkNode *node = _chunks.first(); node; node = _chunks.next(node))
+        size = qMax(size, node->chunk.size());
+    return size;
+}
+
+qint64 Chunks::changedMemory()
+{
+    qint64 memory = 0;
+    for (ChunkNode *node = _chunks.first(); node; node = _chunks.next(node))
+        memory += node->chunk.dataChanged.memoryUsage();
+    return memory;
+}
+
+ChunkSpill *Chunks::spillFile()
+{
+    return _spill.data();
 }
 
 #endif
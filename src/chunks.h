@@ -9,66 +9,195 @@
  * a QByteArray interface, QBuffer is used to provide again a QIODevice like interface. No data
  * will be changed, therefore Chunks opens the QIODevice in QIODevice::ReadOnly mode. After every
  * access Chunks closes the QIODevice, that's why external applications can overwrite files while
- * QHexEdit shows them.
+ * QHexEdit shows them. Optionally a QFile can be memory mapped, then unmodified data is copied
+ * straight out of the mapping and the file stays open. For slow devices Chunks can keep the
+ * device open and cache aligned blocks of it in a LRU cache. All of these options give up the
+ * possibility to change the file externally and are switched off by default.
  *
  * When the the user starts to edit the data, Chunks creates a local copy of a chunk of data (4
- * kilobytes) and notes all changes there. Parallel to that chunk, there is a second chunk,
- * which keep track of which bytes are changed and which not.
+ * kilobytes) and notes all changes there. Parallel to that chunk, there are ChangedBits, one
+ * bit per byte, which keep track of which bytes are changed and which not. The copied chunks are indexed
+ * by a ChunkTree, so finding, inserting and removing data costs O(log n) regardless of the
+ * number of chunks. After every edit, the chunks around it are split, merged or dropped, so
+ * they keep about their size and their number follows the edited span. With a memory budget,
+ * the least recently used chunks beyond it are moved to a ChunkSpill on disk and are loaded
+ * again, when they are accessed.
+ *
+ * Every edit emits contentsChanged() with the range it replaced, so caches of the data only
+ * drop this range. ContentsChange merges several of them into one range.
+ *
+ * A snapshot() describes the data at one moment in a form, which other threads can read
+ * without touching Chunks. ParallelSearch uses it, so the data can be edited while the
+ * search runs.
  *
  */
 
 #include <QtCore>
 
-struct Chunk
+#include "chunkspill.h"
+#include "chunktree.h"
+#include "searchengine.h"
+
+// A piece of the data at the time of the snapshot: copied data, spilled data or source data
+struct SnapshotPiece
 {
+    qint64 pos;
+    qint64 size;
+    qint64 srcPos;                              // -1, if the piece holds data or is spilled
+    qint64 spillPos;                            // data is in the spill file, else -1
     QByteArray data;
-    QByteArray dataChanged;
-    qint64 absPos;
+    ChangedBits dataChanged;
 };
 
-class Chunks: public QObject
+struct ChunksSnapshot
+{
+    QVector<SnapshotPiece> pieces;
+    qint64 size;
+    QString fileName;                           // source is a file
+    QByteArray buffer;                          // source is a QBuffer
+    QSharedPointer<ChunkSpill> spill;           // spilled pieces
+    bool memoryMapped;
+    bool valid;                                 // false, if other threads can not read the source
+};
+
+// A change of the data: the removed bytes at pos were replaced by the added bytes
+struct ContentsChange
+{
+    ContentsChange() : pos(-1), removed(0), added(0) {}
+    void merge(qint64 changePos, qint64 changeRemoved, qint64 changeAdded); // a following change
+
+    qint64 pos;                                 // -1, if nothing changed
+    qint64 removed;
+    qint64 added;
+};
+
+class Chunks: public QObject, private SearchSource
 {
 Q_OBJECT
 public:
     // Constructors and file settings
-    Chunks(QObject *parent);
+    Chunks(QObject *parent=0);
     Chunks(QIODevice &ioDevice, QObject *parent);
+    ~Chunks();
     bool setIODevice(QIODevice &ioDevice);
 
+    // Access to the source
+    bool setMemoryMapped(bool memoryMapped);    // QFile only
+    bool memoryMapped();
+    void setKeepOpen(bool keepOpen);
+    bool keepOpen();
+    void setCacheSize(qint64 cacheSize, int blockSize=0);
+    qint64 cacheSize();
+    qint64 cacheHits();
+    qint64 cacheMisses();
+
+    // Memory budget of the copied chunks
+    void setMemoryBudget(qint64 memoryBudget);
+    qint64 memoryBudget();
+    qint64 residentSize();
+    qint64 spilledSize();
+
     // Getting data out of Chunks
     QByteArray data(qint64 pos=0, qint64 count=-1, QByteArray *highlighted=0);
+    QByteArray data(qint64 pos, qint64 count, ChangedRanges *changed);
     bool write(QIODevice &iODevice, qint64 pos=0, qint64 count=-1);
+    bool writeChanges(QIODevice &iODevice);     // patches the source, overwrites only
 
     // Set and get highlighting infos
     void setDataChanged(qint64 pos, bool dataChanged);
+    void setDataChanged(qint64 pos, const QByteArray &dataChanged);
+    void setDataChanged(qint64 pos, qint64 count, const ChangedRanges &changed);
     bool dataChanged(qint64 pos);
 
     // Search API
     qint64 indexOf(const QByteArray &ba, qint64 from);
     qint64 lastIndexOf(const QByteArray &ba, qint64 from);
+    qint64 indexAll(const QByteArray &ba, MatchIndex &matches, bool overlapping=true,
+                    qint64 from=0, qint64 to=-1);
+    ChunksSnapshot snapshot(qint64 pos=0, qint64 maxSize=-1);
 
     // Char manipulations
     bool insert(qint64 pos, char b);
     bool overwrite(qint64 pos, char b);
     bool removeAt(qint64 pos);
 
+    // ByteArray manipulations
+    bool insert(qint64 pos, const QByteArray &ba);
+    bool overwrite(qint64 pos, const QByteArray &ba);
+    bool remove(qint64 pos, qint64 len);
+    bool replaceAll(const MatchIndex &positions, int len, const QByteArray &ba,
+                    const QByteArray &dataChanged=QByteArray(), QByteArray *oldDataChanged=0);
+
     // Utility functions
     char operator[](qint64 pos);
     qint64 pos();
     qint64 size();
 
+signals:
+    // Every edit tells about the bytes it replaced, replaceAll() about all at once
+    void contentsChanged(qint64 pos, qint64 removed, qint64 added);
+
 
 private:
-    int getChunkIndex(qint64 absPos);
+    ChunkNode *getChunkNode(qint64 absPos, qint64 &posInBa);
+    QByteArray readData(qint64 pos, qint64 maxSize, QByteArray *highlighted, ChangedRanges *changed);
+    void fillDataChanged(qint64 pos, qint64 count, bool changed);
+    void changed(qint64 pos, qint64 removed, qint64 added);
+
+    // Keeping the chunks at about CHUNK_SIZE
+    void compact(qint64 pos, qint64 count);
+    bool equalsSource(ChunkNode *node);
+    bool mergeChunks(ChunkNode *node, ChunkNode *next);
+    void splitChunk(ChunkNode *node);
+
+    // Chunks in memory and in the spill file
+    ChunkNode *insertChunk(ChunkNode *node, const Chunk &chunk);
+    bool touch(ChunkNode *node);                // false, if a spilled chunk can not be loaded
+    void unlink(ChunkNode *node);
+    void removeChunk(ChunkNode *node);
+    void dropSpillCopy(ChunkNode *node);
+    void spill();
+    void compactSpill();
+    bool replaceChunks(const MatchIndex &positions, int len, const QByteArray &ba,
+                       const QByteArray &dataChanged, QByteArray *oldDataChanged);
+
+    // Access to the source device
+    void init();
+    void beginRead();
+    void endRead();
+    qint64 readIODevice(qint64 pos, qint64 maxSize, QByteArray &buffer);
+    bool openIODevice();                        // opened until endRead(), if not kept open
+    qint64 readSegment(qint64 pos, qint64 maxSize, bool backward, const char *&segment, QByteArray &buffer);
+    void mapIODevice();
+    void releaseIODevice();
 
     QIODevice * _ioDevice;
+    QPointer<QIODevice> _openIODevice;          // source, which Chunks keeps open
+    uchar *_map;                                // mapped source, if _openIODevice is a QFile
+    qint64 _mapSize;
+    bool _memoryMapped;
+    bool _keepOpen;
+    QCache<qint64, QByteArray> _cache;          // aligned source blocks, cost 1 per block
+    int _cacheBlockSize;
+    qint64 _cacheHits;
+    qint64 _cacheMisses;
+    int _readDepth;                             // nested beginRead() calls
+    bool _replacing;                            // replaceAll() tells about its edits
     qint64 _pos;
     qint64 _size;
-    QList<Chunk> _chunks;
+    ChunkTree _chunks;
+    qint64 _memoryBudget;                       // 0, if all chunks stay in memory
+    qint64 _spilledSize;
+    ChunkNode *_newest;                         // chunks in memory, most recently used first
+    ChunkNode *_oldest;
+    QSharedPointer<ChunkSpill> _spill;
 
 #ifdef MODUL_TEST
 public:
     int chunkSize();
+    int maxChunkSize();
+    qint64 changedMemory();
+    ChunkSpill *spillFile();
 #endif
 };
 
@@ -0,0 +1,163 @@
+#include "chunkspill.h"
+
+#define MAX_PENDING 0x1000000
+
+
+// ***************************************** Writing in the pool
+
+class SpillWriter: public QRunnable
+{
+public:
+    SpillWriter(ChunkSpill *spill)
+    {
+        _spill = spill;
+    }
+
+    void run()
+    {
+        _spill->run();
+    }
+
+private:
+    ChunkSpill *_spill;
+};
+
+
+// ***************************************** Constructor, destructor
+
+ChunkSpill::ChunkSpill()
+{
+    _pool.setMaxThreadCount(1);
+    _running = false;
+    _failed = !_file.open();
+    if (!_failed)
+    {
+        // Buffered reads could keep bytes, which were not written yet
+        _reader.setFileName(_file.fileName());
+        _failed = !_reader.open(QIODevice::ReadOnly | QIODevice::Unbuffered);
+    }
+    _size = 0;
+    _garbage = 0;
+    _pendingSize = 0;
+}
+
+ChunkSpill::~ChunkSpill()
+{
+    _pool.waitForDone();
+}
+
+bool ChunkSpill::isOpen()
+{
+    QMutexLocker locker(&_mutex);
+    return !_failed;
+}
+
+
+// ***************************************** Writing and reading
+
+qint64 ChunkSpill::write(const QByteArray &data)
+{
+    // The data waits in _pending, so it is not copied
+    QMutexLocker locker(&_mutex);
+    while (_running && !_failed && (_pendingSize > MAX_PENDING))
+        _written.wait(&_mutex);
+    if (_failed)
+        return -1;
+    qint64 pos = _size;
+    _pending.insert(pos, data);
+    _pendingSize += data.size();
+    _size += data.size();
+    if (!_running)
+    {
+        _running = true;
+        _pool.start(new SpillWriter(this));
+    }
+    return pos;
+}
+
+QByteArray ChunkSpill::read(qint64 pos, int size)
+{
+    QMutexLocker locker(&_mutex);
+    QMap<qint64, QByteArray>::const_iterator it = _pending.upperBound(pos);
+    if (it != _pending.constBegin())
+    {
+        --it;
+        if ((pos + size) <= (it.key() + it.value().size()))
+            return it.value().mid((int)(pos - it.key()), size);
+    }
+    _reader.seek(pos);
+    return _reader.read(size);
+}
+
+void ChunkSpill::release(int size)
+{
+    QMutexLocker locker(&_mutex);
+    _garbage += size;
+}
+
+qint64 ChunkSpill::size()
+{
+    QMutexLocker locker(&_mutex);
+    return _size;
+}
+
+qint64 ChunkSpill::garbage()
+{
+    QMutexLocker locker(&_mutex);
+    return _garbage;
+}
+
+
+// ***************************************** Private utility functions
+
+void ChunkSpill::run()
+{
+    // Writes all pending data at once and flushes it, before it leaves memory. After
+    // an error the data stays pending, so nothing is lost.
+    QFile file(_file.fileName());
+    bool ok = file.open(QIODevice::ReadWrite);
+    while (true)
+    {
+        QMutexLocker locker(&_mutex);
+        if (!ok)
+            _failed = true;
+        if (_failed || _pending.isEmpty())
+        {
+            _running = false;
+            _written.wakeAll();
+            return;
+        }
+        QMap<qint64, QByteArray> pending = _pending;
+        locker.unlock();
+
+        QMap<qint64, QByteArray>::const_iterator it;
+        for (it = pending.constBegin(); ok && (it != pending.constEnd()); ++it)
+            ok = file.seek(it.key()) && (file.write(it.value()) == it.value().size());
+        ok = ok && file.flush();
+
+        locker.relock();
+        if (ok)
+            for (it = pending.constBegin(); it != pending.constEnd(); ++it)
+            {
+                _pending.remove(it.key());
+                _pendingSize -= it.value().size();
+            }
+        _written.wakeAll();
+    }
+}
+
+
+#ifdef MODUL_TEST
+QString ChunkSpill::fileName()
+{
+    return _file.fileName();
+}
+
+void ChunkSpill::waitForWritten()
+{
+    QMutexLocker locker(&_mutex);
+    while (_running && !_failed && !_pending.isEmpty())
+        _written.wait(&_mutex);
+}
+
+#endif
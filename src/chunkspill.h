@@ -0,0 +1,64 @@
+#ifndef CHUNKSPILL_H
+#define CHUNKSPILL_H
+
+/** \cond docNever */
+
+/*! ChunkSpill keeps the data of chunks, which Chunks moved out of memory.
+ *
+ * The data is appended to a temporary file, a place in the file is never written
+ * twice, so snapshots, which refer to the spill file, stay valid as long as they
+ * hold it. Places, which Chunks does not use any more, are counted as garbage,
+ * Chunks moves the rest into a new spill file, when the garbage gets too big.
+ *
+ * A thread of its own writes the data, until then read() takes it out of memory.
+ * write() waits, when too much data is pending. read() may be called by any thread.
+ */
+
+#include <QtCore>
+#include <QMutex>
+#include <QTemporaryFile>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+class ChunkSpill
+{
+public:
+    ChunkSpill();
+    ~ChunkSpill();
+
+    bool isOpen();
+    qint64 write(const QByteArray &data);       // position in the file, -1 on errors
+    QByteArray read(qint64 pos, int size);
+    void release(int size);                     // a place is not used any more
+
+    qint64 size();                              // bytes written
+    qint64 garbage();                           // bytes released
+
+private:
+    Q_DISABLE_COPY(ChunkSpill)
+    friend class SpillWriter;
+
+    void run();                                 // runs in _pool
+
+    QThreadPool _pool;
+    QMutex _mutex;                              // guards all of the following
+    QTemporaryFile _file;
+    QFile _reader;                              // unbuffered, the writer has its own QFile
+    QMap<qint64, QByteArray> _pending;          // data, which is not written yet
+    qint64 _pendingSize;
+    QWaitCondition _written;
+    bool _running;
+    bool _failed;
+    qint64 _size;
+    qint64 _garbage;
+
+#ifdef MODUL_TEST
+public:
+    QString fileName();
+    void waitForWritten();                      // no data is pending any more
+#endif
+};
+
+/** \endcond docNever */
+
+#endif // CHUNKSPILL_H
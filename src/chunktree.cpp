@@ -0,0 +1,270 @@
+#include "chunktree.h"
+
+
+// ***************************************** Constructor, destructor
+
+ChunkTree::ChunkTree()
+{
+    _root = 0;
+    _seed = 0x9e3779b9;
+}
+
+ChunkTree::~ChunkTree()
+{
+    clear();
+}
+
+void ChunkTree::clear()
+{
+    deleteSubtree(_root);
+    _root = 0;
+}
+
+
+// ***************************************** Tree information
+
+int ChunkTree::count()
+{
+    return _root ? _root->count : 0;
+}
+
+qint64 ChunkTree::delta()
+{
+    return _root ? _root->delta : 0;
+}
+
+qint64 ChunkTree::size()
+{
+    return _root ? _root->size : 0;
+}
+
+
+// ***************************************** Navigation
+
+ChunkNode *ChunkTree::first()
+{
+    ChunkNode *node = _root;
+    if (node)
+        while (node->left)
+            node = node->left;
+    return node;
+}
+
+ChunkNode *ChunkTree::next(ChunkNode *node)
+{
+    if (node->right)
+    {
+        node = node->right;
+        while (node->left)
+            node = node->left;
+        return node;
+    }
+    while (node->parent && (node->parent->right == node))
+        node = node->parent;
+    return node->parent;
+}
+
+ChunkNode *ChunkTree::prev(ChunkNode *node)
+{
+    if (node->left)
+    {
+        node = node->left;
+        while (node->right)
+            node = node->right;
+        return node;
+    }
+    while (node->parent && (node->parent->left == node))
+        node = node->parent;
+    return node->parent;
+}
+
+ChunkNode *ChunkTree::last()
+{
+    ChunkNode *node = _root;
+    if (node)
+        while (node->right)
+            node = node->right;
+    return node;
+}
+
+ChunkNode *ChunkTree::lowerBound(qint64 pos, qint64 &deltaBefore)
+{
+    // Returns the first chunk, which ends behind pos. deltaBefore is the delta of
+    // all chunks in front of it, pos - deltaBefore is the matching position in the
+    // source, when pos is not inside of the returned chunk.
+
+    ChunkNode *result = 0;
+    ChunkNode *node = _root;
+    qint64 ioDelta = 0;
+
+    while (node)
+    {
+        qint64 leftDelta = node->left ? node->left->delta : 0;
+        qint64 chunkPos = node->chunk.srcPos + ioDelta + leftDelta;
+        if ((chunkPos + node->chunk.size()) > pos)
+        {
+            result = node;
+            deltaBefore = ioDelta + leftDelta;
+            node = node->left;
+        }
+        else
+        {
+            ioDelta += leftDelta + node->chunk.size() - node->chunk.srcSize;
+            node = node->right;
+        }
+    }
+    if (!result)
+        deltaBefore = ioDelta;
+    return result;
+}
+
+
+// ***************************************** Manipulations
+
+ChunkNode *ChunkTree::insertBefore(ChunkNode *node, const Chunk &chunk)
+{
+    ChunkNode *newNode = new ChunkNode;
+    newNode->chunk = chunk;
+    newNode->left = 0;
+    newNode->right = 0;
+    newNode->older = 0;
+    newNode->newer = 0;
+
+    // xorshift32, the priorities only have to be well distributed
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 17;
+    _seed ^= _seed << 5;
+    newNode->priority = _seed;
+
+    // Hang the new node in as a leaf directly in front of node
+    ChunkNode *parent;
+    if (!node)
+    {
+        parent = _root;
+        if (parent)
+        {
+            while (parent->right)
+                parent = parent->right;
+            parent->right = newNode;
+        }
+        else
+            _root = newNode;
+    }
+    else if (!node->left)
+    {
+        parent = node;
+        parent->left = newNode;
+    }
+    else
+    {
+        parent = node->left;
+        while (parent->right)
+            parent = parent->right;
+        parent->right = newNode;
+    }
+    newNode->parent = parent;
+    recalc(newNode);
+
+    // Restore the heap order of the priorities
+    while (newNode->parent && (newNode->priority > newNode->parent->priority))
+        rotateUp(newNode);
+    update(newNode->parent);
+    return newNode;
+}
+
+void ChunkTree::remove(ChunkNode *node)
+{
+    // Rotate the node down, until it has one child at most
+    while (node->left && node->right)
+    {
+        if (node->left->priority > node->right->priority)
+            rotateUp(node->left);
+        else
+            rotateUp(node->right);
+    }
+
+    ChunkNode *child = node->left ? node->left : node->right;
+    ChunkNode *parent = node->parent;
+    if (child)
+        child->parent = parent;
+    if (!parent)
+        _root = child;
+    else if (parent->left == node)
+        parent->left = child;
+    else
+        parent->right = child;
+    delete node;
+    update(parent);
+}
+
+void ChunkTree::update(ChunkNode *node)
+{
+    // Call this after the size of a chunk has changed
+    for (; node; node = node->parent)
+        recalc(node);
+}
+
+
+// ***************************************** Private utility functions
+
+void ChunkTree::deleteSubtree(ChunkNode *node)
+{
+    if (node)
+    {
+        deleteSubtree(node->left);
+        deleteSubtree(node->right);
+        delete node;
+    }
+}
+
+void ChunkTree::recalc(ChunkNode *node)
+{
+    node->delta = node->chunk.size() - node->chunk.srcSize;
+    node->size = node->chunk.size();
+    node->count = 1;
+    if (node->left)
+    {
+        node->delta += node->left->delta;
+        node->size += node->left->size;
+        node->count += node->left->count;
+    }
+    if (node->right)
+    {
+        node->delta += node->right->delta;
+        node->size += node->right->size;
+        node->count += node->right->count;
+    }
+}
+
+void ChunkTree::rotateUp(ChunkNode *node)
+{
+    ChunkNode *parent = node->parent;
+    ChunkNode *grandParent = parent->parent;
+
+    if (parent->left == node)
+    {
+        parent->left = node->right;
+        if (node->right)
+            node->right->parent = parent;
+        node->right = parent;
+    }
+    else
+    {
+        parent->right = node->left;
+        if (node->left)
+            node->left->parent = parent;
+        node->left = parent;
+    }
+    parent->parent = node;
+    node->parent = grandParent;
+
+    if (!grandParent)
+        _root = node;
+    else if (grandParent->left == parent)
+        grandParent->left = node;
+    else
+        grandParent->right = node;
+
+    recalc(parent);
+    recalc(node);
+}
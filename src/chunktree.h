@@ -0,0 +1,90 @@
+#ifndef CHUNKTREE_H
+#define CHUNKTREE_H
+
+/** \cond docNever */
+
+/*! ChunkTree is the index of the copied chunks inside Chunks.
+ *
+ * Every chunk replaces a range of the source device (srcPos, srcSize) with its own
+ * data. The chunks are kept in source order in a balanced binary tree (a treap),
+ * where every node knows the size difference between its data and the replaced
+ * source data summed up over its whole subtree (delta). The logical position of
+ * a chunk is its source position plus the delta of all chunks in front of it.
+ * This way a position is found in O(log n) and a chunk, which grows or shrinks,
+ * only has to update the nodes on its path to the root.
+ *
+ * The data of a chunk may be spilled to disk by Chunks, then size() is the size of
+ * the spilled data. The nodes carry the list of the chunks in memory for Chunks,
+ * ChunkTree does not touch it.
+ */
+
+#include <QtCore>
+
+#include "changedbits.h"
+
+struct Chunk
+{
+    Chunk() : srcPos(0), srcSize(0), spillPos(-1), spillSize(0), spilled(false) {}
+    int size() const { return spilled ? spillSize : data.size(); }
+
+    QByteArray data;
+    ChangedBits dataChanged;
+    qint64 srcPos;                              // position of replaced data in source
+    qint64 srcSize;                             // size of replaced data in source
+    qint64 spillPos;                            // copy of data in the spill file, -1 if none
+    int spillSize;
+    bool spilled;                               // data is in the spill file only
+};
+
+struct ChunkNode
+{
+    Chunk chunk;
+    ChunkNode *parent;
+    ChunkNode *left;
+    ChunkNode *right;
+    quint32 priority;
+    qint64 delta;                               // sum of (data.size() - srcSize) in subtree
+    qint64 size;                                // sum of data.size() in subtree
+    int count;                                  // number of nodes in subtree
+    ChunkNode *older;                           // list of the chunks in memory
+    ChunkNode *newer;
+};
+
+class ChunkTree
+{
+public:
+    ChunkTree();
+    ~ChunkTree();
+    void clear();
+
+    // Tree information
+    int count();
+    qint64 delta();
+    qint64 size();
+
+    // Navigation
+    ChunkNode *first();
+    ChunkNode *last();
+    ChunkNode *next(ChunkNode *node);
+    ChunkNode *prev(ChunkNode *node);
+    ChunkNode *lowerBound(qint64 pos, qint64 &deltaBefore);
+
+    // Manipulations
+    ChunkNode *insertBefore(ChunkNode *node, const Chunk &chunk);
+    void remove(ChunkNode *node);
+    void update(ChunkNode *node);
+
+private:
+    Q_DISABLE_COPY(ChunkTree)
+
+    void deleteSubtree(ChunkNode *node);
+    void recalc(ChunkNode *node);
+    void rotateUp(ChunkNode *node);
+
+    ChunkNode *_root;
+    quint32 _seed;
+};
+
+/** \endcond docNever */
+
+#endif // CHUNKTREE_H
@@ -1,14 +1,339 @@
 #include "commands.h"
+#include <QMutex>
+#include <QRunnable>
+#include <QSharedPointer>
 #include <QUndoCommand>
 
+#define COMMAND_SIZE 64                         // about the memory of a command without its data
+#define COMPRESS_SIZE 0x1000                    // smaller data is not compressed
+#define JOURNAL_SIZE 0x10000                    // smaller data is not written to the journal
+
+class UndoData;
+
+
+// Compression of UndoData in the pool of UndoStack
+struct PackJob
+{
+    PackJob() : done(false) {}
+    QByteArray data;                            // read by the worker only
+    QMutex mutex;                               // guards the following
+    QByteArray packed;
+    bool done;
+};
+
+class PackWorker : public QRunnable
+{
+public:
+    PackWorker(const QSharedPointer<PackJob> &job, QObject *stack)
+    {
+        _job = job;
+        _stack = stack;
+    }
+
+    void run()
+    {
+        QByteArray packed = qCompress(_job->data);
+        _job->data.clear();
+        QMutexLocker locker(&_job->mutex);
+        _job->packed = packed;
+        _job->done = true;
+        locker.unlock();
+        QMetaObject::invokeMethod(_stack, "limit", Qt::QueuedConnection);
+    }
+
+private:
+    QSharedPointer<PackJob> _job;
+    QObject *_stack;                            // waits for the pool, before it is deleted
+};
+
+// Memory of the commands of one UndoStack. UndoCommand and UndoData keep it up to
+// date, whenever their size changes, so the stack never has to add it up.
+struct UndoMemory
+{
+    UndoMemory() : usage(0) {}
+    qint64 usage;
+    QList<UndoData *> packing;                  // compressions, which are running
+};
+
+// Bytes of a command, which are compressed, when the command gets old. Until the
+// compression is done, the bytes are used as they are. Big ones may be kept in the
+// journal of UndoStack, then only their place is in memory.
+class UndoData
+{
+public:
+    UndoData(UndoMemory *memory)
+    {
+        _memory = memory;
+        _accounted = 0;
+        _size = 0;
+        _packed = false;
+        _tried = false;
+        _journalPos = 0;
+        _journalSize = 0;
+    }
+
+    ~UndoData()
+    {
+        leaveJournal();
+        dropJob();
+        _memory->usage -= _accounted;
+    }
+
+    void set(const QByteArray &data)
+    {
+        leaveJournal();
+        dropJob();                              // a running compression is outdated
+        _data = data;
+        _size = data.size();
+        _packed = false;
+        _tried = false;
+        account();
+    }
+
+    QByteArray data()
+    {
+        collect();
+        QByteArray data = _journal.isNull() ? _data : _journal->read(_journalPos, _journalSize);
+        return _packed ? qUncompress(data) : data;
+    }
+
+    int size() const
+    {
+        return _size;
+    }
+
+    void compress(QThreadPool &pool, QObject *stack)
+    {
+        collect();
+        if (_packed || _tried || !_job.isNull() || !_journal.isNull() || (_size < COMPRESS_SIZE))
+            return;
+        _job = QSharedPointer<PackJob>(new PackJob());
+        _job->data = _data;
+        _memory->packing.append(this);
+        pool.start(new PackWorker(_job, stack));
+    }
+
+    // Takes the result of a finished compression
+    void collect()
+    {
+        if (_job.isNull())
+            return;
+        QMutexLocker locker(&_job->mutex);
+        if (!_job->done)
+            return;
+        if (_job->packed.size() < _size)        // random bytes do not get smaller
+        {
+            _data = _job->packed;
+            _packed = true;
+        }
+        _tried = true;
+        locker.unlock();
+        dropJob();
+        account();
+    }
+
+    void release()
+    {
+        leaveJournal();
+        dropJob();
+        _data.clear();
+        _packed = false;
+        _tried = true;
+        account();
+    }
+
+    // Big data is appended to journal, a running compression is not waited for
+    void journal(const QSharedPointer<ChunkSpill> &journal)
+    {
+        collect();
+        if (!_journal.isNull() || (_data.size() < JOURNAL_SIZE))
+            return;
+        qint64 pos = journal->write(_data);
+        if (pos < 0)
+            return;                             // no journal, the data stays
+        _journal = journal;
+        _journalPos = pos;
+        _journalSize = _data.size();
+        _data = QByteArray();
+        _tried = true;
+        dropJob();
+        account();
+    }
+
+    // The data moves to journal, into memory, if it is null
+    void moveJournal(const QSharedPointer<ChunkSpill> &journal)
+    {
+        if (_journal.isNull())
+            return;
+        QByteArray data = _journal->read(_journalPos, _journalSize);
+        _journal.clear();
+        _data = data;
+        account();
+        if (!journal.isNull())
+            this->journal(journal);
+    }
+
+private:
+    void account()
+    {
+        _memory->usage += _data.size() - _accounted;
+        _accounted = _data.size();
+    }
+
+    void dropJob()
+    {
+        if (!_job.isNull())
+            _memory->packing.removeOne(this);
+        _job.clear();
+    }
+
+    void leaveJournal()
+    {
+        if (!_journal.isNull())
+            _journal->release(_journalSize);
+        _journal.clear();
+    }
+
+    UndoMemory *_memory;
+    qint64 _accounted;                          // part of _memory->usage
+    QByteArray _data;                           // compressed, if _packed
+    int _size;
+    bool _packed;
+    bool _tried;                                // compressed or not worth it
+    QSharedPointer<PackJob> _job;
+    QSharedPointer<ChunkSpill> _journal;        // holds the data, if not null
+    qint64 _journalPos;
+    int _journalSize;
+};
+
+// Base class of all commands of UndoStack. It counts itself and its data, which is
+// not in UndoData, in the memory of the stack. A command without data of its own is
+// the parent of the remove and the insert of an overwrite.
+class UndoCommand : public QUndoCommand
+{
+public:
+    UndoCommand(UndoMemory *memory, QUndoCommand *parent=0) : QUndoCommand(parent)
+    {
+        _memory = memory;
+        _extraSize = 0;
+        _released = false;
+        _memory->usage += COMMAND_SIZE;
+    }
+
+    ~UndoCommand()
+    {
+        if (!_released)
+            _memory->usage -= COMMAND_SIZE + _extraSize;
+    }
+
+    void compress(QThreadPool &pool, QObject *stack)
+    {
+        QList<UndoData *> data = undoData();
+        for (int idx=0; idx < data.size(); idx++)
+            data.at(idx)->compress(pool, stack);
+    }
+
+    // The command is dropped, its memory is not counted any more
+    virtual void release()
+    {
+        QList<UndoData *> data = undoData();
+        for (int idx=0; idx < data.size(); idx++)
+            data.at(idx)->release();
+        if (!_released)
+            _memory->usage -= COMMAND_SIZE + _extraSize;
+        _extraSize = 0;
+        _released = true;
+    }
+
+    void journal(const QSharedPointer<ChunkSpill> &journal)
+    {
+        QList<UndoData *> data = undoData();
+        for (int idx=0; idx < data.size(); idx++)
+            data.at(idx)->journal(journal);
+    }
+
+    void moveJournal(const QSharedPointer<ChunkSpill> &journal)
+    {
+        QList<UndoData *> data = undoData();
+        for (int idx=0; idx < data.size(); idx++)
+            data.at(idx)->moveJournal(journal);
+    }
+
+protected:
+    virtual QList<UndoData *> undoData() { return QList<UndoData *>(); }
+
+    void setExtraSize(qint64 extraSize)
+    {
+        if (_released)
+            return;
+        _memory->usage += extraSize - _extraSize;
+        _extraSize = extraSize;
+    }
+
+private:
+    UndoMemory *_memory;
+    qint64 _extraSize;                          // part of _memory->usage
+    bool _released;
+};
+
+// A step on the stack. The steps share their commands, so UndoStack can push them
+// anew without the dropped ones. A replayed step neither merges nor does anything,
+// the data is as it is already.
+class UndoStep : public QUndoCommand
+{
+public:
+    UndoStep(const QSharedPointer<UndoCommand> &command)
+    {
+        _command = command;
+        _replayed = false;
+        setText(command->text());
+    }
+
+    void undo()
+    {
+        if (!_replayed)
+            _command->undo();
+    }
+
+    void redo()
+    {
+        if (!_replayed)
+            _command->redo();
+    }
+
+    int id() const
+    {
+        return _replayed ? -1 : _command->id();
+    }
+
+    bool mergeWith(const QUndoCommand *command)
+    {
+        return _command->mergeWith(static_cast<const UndoStep *>(command)->_command.data());
+    }
+
+    QSharedPointer<UndoCommand> command() const
+    {
+        return _command;
+    }
+
+    void setReplayed(bool replayed)
+    {
+        _replayed = replayed;
+    }
+
+private:
+    QSharedPointer<UndoCommand> _command;
+    bool _replayed;
+};
+
 
 // Helper class to store single byte commands
-class CharCommand : public QUndoCommand
+class CharCommand : public UndoCommand
 {
 public:
     enum CCmd {insert, removeAt, overwrite};
 
-    CharCommand(Chunks * chunks, CCmd cmd, qint64 charPos, char newChar,
+    CharCommand(Chunks * chunks, UndoMemory *memory, CCmd cmd, qint64 charPos, char newChar,
                        QUndoCommand *parent=0);
 
     void undo();
@@ -25,8 +350,8 @@ private:
     CCmd _cmd;
 };
 
-CharCommand::CharCommand(Chunks * chunks, CCmd cmd, qint64 charPos, char newChar, QUndoCommand *parent)
-    : QUndoCommand(parent)
+CharCommand::CharCommand(Chunks * chunks, UndoMemory *memory, CCmd cmd, qint64 charPos, char newChar, QUndoCommand *parent)
+    : UndoCommand(memory, parent)
 {
     _chunks = chunks;
     _charPos = charPos;
@@ -89,34 +414,239 @@ void CharCommand::redo()
     }
 }
 
+// Helper classes to store byte array commands. The affected bytes are stored only
+// once and are applied with a single call of the byte array manipulations of Chunks.
+class InsertRangeCommand : public UndoCommand
+{
+public:
+    InsertRangeCommand(Chunks * chunks, UndoMemory *memory, qint64 pos, const QByteArray &newData,
+                       QUndoCommand *parent=0);
+
+    void undo();
+    void redo();
+
+protected:
+    QList<UndoData *> undoData() { return QList<UndoData *>() << &_newData; }
+
+private:
+    Chunks * _chunks;
+    qint64 _pos;
+    UndoData _newData;
+};
+
+InsertRangeCommand::InsertRangeCommand(Chunks * chunks, UndoMemory *memory, qint64 pos, const QByteArray &newData, QUndoCommand *parent)
+    : UndoCommand(memory, parent), _newData(memory)
+{
+    _chunks = chunks;
+    _pos = pos;
+    _newData.set(newData);
+}
+
+void InsertRangeCommand::undo()
+{
+    _chunks->remove(_pos, _newData.size());
+}
+
+void InsertRangeCommand::redo()
+{
+    _chunks->insert(_pos, _newData.data());
+}
+
+class RemoveRangeCommand : public UndoCommand
+{
+public:
+    RemoveRangeCommand(Chunks * chunks, UndoMemory *memory, qint64 pos, qint64 len, QUndoCommand *parent=0);
+
+    void undo();
+    void redo();
+    void release();
+
+protected:
+    QList<UndoData *> undoData() { return QList<UndoData *>() << &_oldData; }
+
+private:
+    Chunks * _chunks;
+    qint64 _pos;
+    qint64 _len;
+    UndoData _oldData;
+    ChangedRanges _oldChanged;
+};
+
+RemoveRangeCommand::RemoveRangeCommand(Chunks * chunks, UndoMemory *memory, qint64 pos, qint64 len, QUndoCommand *parent)
+    : UndoCommand(memory, parent), _oldData(memory)
+{
+    _chunks = chunks;
+    _pos = pos;
+    _len = len;
+}
+
+void RemoveRangeCommand::undo()
+{
+    _chunks->insert(_pos, _oldData.data());
+    _chunks->setDataChanged(_pos, _oldData.size(), _oldChanged);
+}
+
+void RemoveRangeCommand::redo()
+{
+    _oldData.set(_chunks->data(_pos, _len, &_oldChanged));
+    setExtraSize(_oldChanged.size() * (qint64)sizeof(ChangedRange));
+    _chunks->remove(_pos, _len);
+}
+
+void RemoveRangeCommand::release()
+{
+    UndoCommand::release();
+    _oldChanged.clear();
+}
+
+class OverwriteRangeCommand : public UndoCommand
+{
+public:
+    OverwriteRangeCommand(Chunks * chunks, UndoMemory *memory, qint64 pos, const QByteArray &newData,
+                          QUndoCommand *parent=0);
+
+    void undo();
+    void redo();
+    void release();
+
+protected:
+    QList<UndoData *> undoData() { return QList<UndoData *>() << &_newData << &_oldData; }
+
+private:
+    Chunks * _chunks;
+    qint64 _pos;
+    UndoData _newData;
+    UndoData _oldData;
+    ChangedRanges _oldChanged;
+};
+
+OverwriteRangeCommand::OverwriteRangeCommand(Chunks * chunks, UndoMemory *memory, qint64 pos, const QByteArray &newData, QUndoCommand *parent)
+    : UndoCommand(memory, parent), _newData(memory), _oldData(memory)
+{
+    _chunks = chunks;
+    _pos = pos;
+    _newData.set(newData);
+}
+
+void OverwriteRangeCommand::undo()
+{
+    _chunks->overwrite(_pos, _oldData.data());
+    _chunks->setDataChanged(_pos, _oldData.size(), _oldChanged);
+}
+
+void OverwriteRangeCommand::redo()
+{
+    _oldData.set(_chunks->data(_pos, _newData.size(), &_oldChanged));
+    setExtraSize(_oldChanged.size() * (qint64)sizeof(ChangedRange));
+    _chunks->overwrite(_pos, _newData.data());
+}
+
+void OverwriteRangeCommand::release()
+{
+    UndoCommand::release();
+    _oldChanged.clear();
+}
+
+class ReplaceAllCommand : public UndoCommand
+{
+public:
+    ReplaceAllCommand(Chunks * chunks, UndoMemory *memory, const MatchIndex &positions, const QByteArray &pattern,
+                      const QByteArray &replacement, QUndoCommand *parent=0);
+
+    void undo();
+    void redo();
+    void release();
+
+protected:
+    QList<UndoData *> undoData() { return QList<UndoData *>() << &_oldChanged; }
+
+private:
+    Chunks * _chunks;
+    MatchIndex _positions;
+    QByteArray _pattern;
+    QByteArray _replacement;
+    UndoData _oldChanged;
+};
+
+ReplaceAllCommand::ReplaceAllCommand(Chunks * chunks, UndoMemory *memory, const MatchIndex &positions, const QByteArray &pattern,
+                                     const QByteArray &replacement, QUndoCommand *parent)
+    : UndoCommand(memory, parent), _oldChanged(memory)
+{
+    _chunks = chunks;
+    _positions = positions;
+    _pattern = pattern;
+    _replacement = replacement;
+    setExtraSize(_positions.memoryUsage());
+}
+
+void ReplaceAllCommand::undo()
+{
+    // Every replacement moved by the size differences of the ones in front of it
+    MatchIndex replaced;
+    qint64 shift = 0;
+    for (int block=0; block < _positions.blockCount(); block++)
+    {
+        QVector<qint64> positions = _positions.block(block);
+        for (int idx=0; idx < positions.size(); idx++)
+        {
+            replaced.append(positions.at(idx) + shift);
+            shift += _replacement.size() - _pattern.size();
+        }
+    }
+    _chunks->replaceAll(replaced, _replacement.size(), _pattern, _oldChanged.data());
+}
+
+void ReplaceAllCommand::redo()
+{
+    QByteArray oldChanged;
+    _chunks->replaceAll(_positions, _pattern.size(), _replacement, QByteArray(), &oldChanged);
+    _oldChanged.set(oldChanged);
+}
+
+void ReplaceAllCommand::release()
+{
+    UndoCommand::release();
+    _positions.clear();
+}
+
 UndoStack::UndoStack(Chunks * chunks, QObject * parent)
     : QUndoStack(parent)
 {
     _chunks = chunks;
     _parent = parent;
+    _pool.setMaxThreadCount(1);
+    _memory = new UndoMemory();
+    _memoryBudget = 0;
+    _index = 0;
+    _compressed = 0;
+    _journaled = 0;
+    _trimmed = false;
+    connect(this, SIGNAL(indexChanged(int)), this, SLOT(moved(int)));
+}
+
+UndoStack::~UndoStack()
+{
+    // The workers call limit(), when they are done. The commands count themselves in
+    // _memory, so they are deleted before it, without telling anybody.
+    _pool.waitForDone();
+    blockSignals(true);
+    QUndoStack::clear();
+    delete _memory;
 }
 
 void UndoStack::insert(qint64 pos, char c)
 {
     if ((pos >= 0) && (pos <= _chunks->size()))
-    {
-        QUndoCommand *cc = new CharCommand(_chunks, CharCommand::insert, pos, c);
-        this->push(cc);
-    }
+        pushCommand(new CharCommand(_chunks, _memory, CharCommand::insert, pos, c));
 }
 
 void UndoStack::insert(qint64 pos, const QByteArray &ba)
 {
     if ((pos >= 0) && (pos <= _chunks->size()))
     {
-        QString txt = QString(tr("Inserting %1 bytes")).arg(ba.size());
-        beginMacro(txt);
-        for (int idx=0; idx < ba.size(); idx++)
-        {
-            QUndoCommand *cc = new CharCommand(_chunks, CharCommand::insert, pos + idx, ba.at(idx));
-            this->push(cc);
-        }
-        endMacro();
+        UndoCommand *cc = new InsertRangeCommand(_chunks, _memory, pos, ba);
+        cc->setText(QString(tr("Inserting %1 bytes")).arg(ba.size()));
+        pushCommand(cc);
     }
 }
 
@@ -124,21 +654,19 @@ void UndoStack::removeAt(qint64 pos, qint64 len)
 {
     if ((pos >= 0) && (pos < _chunks->size()))
     {
+        if ((pos + len) > _chunks->size())
+            len = _chunks->size() - pos;
+        if (len > UNDO_RANGE_MAX)
+            return;
         if (len==1)
         {
-            QUndoCommand *cc = new CharCommand(_chunks, CharCommand::removeAt, pos, char(0));
-            this->push(cc);
+            pushCommand(new CharCommand(_chunks, _memory, CharCommand::removeAt, pos, char(0)));
         }
-        else
+        else if (len > 1)
         {
-            QString txt = QString(tr("Delete %1 chars")).arg(len);
-            beginMacro(txt);
-            for (qint64 cnt=0; cnt<len; cnt++)
-            {
-                QUndoCommand *cc = new CharCommand(_chunks, CharCommand::removeAt, pos, char(0));
-                push(cc);
-            }
-            endMacro();
+            UndoCommand *cc = new RemoveRangeCommand(_chunks, _memory, pos, len);
+            cc->setText(QString(tr("Delete %1 chars")).arg(len));
+            pushCommand(cc);
         }
     }
 }
@@ -146,20 +674,236 @@ void UndoStack::removeAt(qint64 pos, qint64 len)
 void UndoStack::overwrite(qint64 pos, char c)
 {
     if ((pos >= 0) && (pos < _chunks->size()))
+        pushCommand(new CharCommand(_chunks, _memory, CharCommand::overwrite, pos, c));
+}
+
+void UndoStack::overwrite(qint64 pos, qint64 len, const QByteArray &ba)
+{
+    if ((pos >= 0) && (pos < _chunks->size()) && (qMin(len, _chunks->size() - pos) <= UNDO_RANGE_MAX))
     {
-        QUndoCommand *cc = new CharCommand(_chunks, CharCommand::overwrite, pos, c);
-        this->push(cc);
+        QString txt = QString(tr("Overwrite %1 chars")).arg(len);
+        UndoCommand *cc;
+        if ((len == ba.size()) && ((pos + len) <= _chunks->size()))
+            cc = new OverwriteRangeCommand(_chunks, _memory, pos, ba);
+        else
+        {
+            // A remove and an insert as children of one command, QUndoCommand does
+            // them in this order and undoes them the other way round
+            len = qMin(len, _chunks->size() - pos);
+            cc = new UndoCommand(_memory);
+            if (len > 0)
+                new RemoveRangeCommand(_chunks, _memory, pos, len, cc);
+            new InsertRangeCommand(_chunks, _memory, pos, ba, cc);
+        }
+        cc->setText(txt);
+        pushCommand(cc);
     }
 }
 
-void UndoStack::overwrite(qint64 pos, int len, const QByteArray &ba)
+qint64 UndoStack::replaceAll(const QByteArray &ba, const QByteArray &replacement, qint64 from, qint64 to)
 {
-    if ((pos >= 0) && (pos < _chunks->size()))
+    MatchIndex positions;
+    qint64 count = _chunks->indexAll(ba, positions, false, from, to);
+    if (count > 0)
     {
-        QString txt = QString(tr("Overwrite %1 chars")).arg(len);
-        beginMacro(txt);
-        removeAt(pos, len);
-        insert(pos, ba);
-        endMacro();
+        UndoCommand *cc = new ReplaceAllCommand(_chunks, _memory, positions, ba, replacement);
+        cc->setText(QString(tr("Replace %1 occurrences")).arg(count));
+        pushCommand(cc);
+    }
+    return count;
+}
+
+void UndoStack::setMemoryBudget(qint64 memoryBudget)
+{
+    _memoryBudget = memoryBudget;
+    limit();
+}
+
+qint64 UndoStack::memoryBudget()
+{
+    return _memoryBudget;
+}
+
+qint64 UndoStack::memoryUsage()
+{
+    return _memory->usage;
+}
+
+bool UndoStack::trimmed() const
+{
+    return _trimmed;
+}
+
+void UndoStack::setJournal(bool journal)
+{
+    if (journal && _journal.isNull())
+    {
+        _journal = QSharedPointer<ChunkSpill>(new ChunkSpill());
+        for (int idx=0; idx < count(); idx++)
+            journalStep(idx);
+        _journaled = index();
+        limit();
+    }
+    else if (!journal && !_journal.isNull())
+    {
+        moveJournal(QSharedPointer<ChunkSpill>());
+        _journal.clear();
+        limit();
+    }
+}
+
+bool UndoStack::journal()
+{
+    return !_journal.isNull();
+}
+
+qint64 UndoStack::journalSize()
+{
+    return _journal.isNull() ? 0 : _journal->size() - _journal->garbage();
+}
+
+void UndoStack::moved(int idx)
+{
+    // Pushes, undo, redo and setIndex() of QUndoStack end up here. The steps between
+    // the old and the new index were done or undone, a merge changed the step in
+    // front of the index. They are compressed and journaled again.
+    int first = (idx == _index) ? idx - 1 : qMin(idx, _index);
+    _compressed = qMax(qMin(_compressed, first), 0);
+    _journaled = qMax(qMin(_journaled, first), 0);
+    _index = idx;
+    if (count() == 0)
+        _trimmed = false;                       // cleared
+    limit();
+}
+
+void UndoStack::limit()
+{
+    if (!_journal.isNull())
+    {
+        // Deleted and dropped steps leave garbage in the journal, when it is more than
+        // the half, the rest is written to a new one and the old file is removed. The
+        // other steps are in the journal already, only the changed ones may have new data.
+        if ((_journal->garbage() * 2) > _journal->size())
+        {
+            QSharedPointer<ChunkSpill> journal(new ChunkSpill());
+            moveJournal(journal);
+            _journal = journal;
+        }
+        for (; _journaled < index(); _journaled++)
+            journalStep(_journaled);
+    }
+    // Finished compressions make the usage smaller
+    QList<UndoData *> packing = _memory->packing;
+    for (int idx=0; idx < packing.size(); idx++)
+        packing.at(idx)->collect();
+    if ((_memoryBudget <= 0) || (_memory->usage <= _memoryBudget))
+        return;
+
+    // All steps but the newest are handed to the compression once, the oldest first.
+    // When the workers are done, they call limit() again.
+    for (; _compressed < (index() - 1); _compressed++)
+    {
+        QList<UndoCommand *> cmds = commands(_compressed);
+        for (int cmd=0; cmd < cmds.size(); cmd++)
+            cmds.at(cmd)->compress(_pool, this);
+    }
+    if (!_memory->packing.isEmpty())
+        return;
+
+    // Still too much, the oldest steps are dropped
+    int dropped = 0;
+    for (; (dropped < index()) && (_memory->usage > _memoryBudget); dropped++)
+    {
+        QList<UndoCommand *> cmds = commands(dropped);
+        for (int cmd=0; cmd < cmds.size(); cmd++)
+            cmds.at(cmd)->release();
+    }
+    if (dropped > 0)
+        trim(dropped);
+}
+
+void UndoStack::pushCommand(UndoCommand *command)
+{
+    // moved() limits the memory
+    push(new UndoStep(QSharedPointer<UndoCommand>(command)));
+}
+
+void UndoStack::trim(int dropped)
+{
+    // QUndoStack can not take steps off the bottom. The steps share their commands,
+    // so the others are pushed anew as replayed steps and the index is set back
+    // without undoing them. The signals tell about the new stack once at the end.
+    QList<QSharedPointer<UndoCommand> > kept;
+    for (int idx=dropped; idx < count(); idx++)
+        kept.append(static_cast<const UndoStep *>(command(idx))->command());
+    int index = this->index() - dropped;
+    bool blocked = blockSignals(true);
+    QUndoStack::clear();
+    for (int idx=0; idx < kept.size(); idx++)
+    {
+        UndoStep *step = new UndoStep(kept.at(idx));
+        step->setReplayed(true);
+        push(step);
+    }
+    setIndex(index);
+    for (int idx=0; idx < count(); idx++)
+        static_cast<UndoStep *>(const_cast<QUndoCommand *>(command(idx)))->setReplayed(false);
+#if QT_VERSION >= 0x050800
+    resetClean();                               // the data of the clean state is gone
+#endif
+    blockSignals(blocked);
+
+    _index = index;
+    _compressed = qMax(_compressed - dropped, 0);
+    _journaled = qMax(_journaled - dropped, 0);
+    _trimmed = true;
+    emit indexChanged(index);
+    emit canUndoChanged(canUndo());
+    emit canRedoChanged(canRedo());
+    emit undoTextChanged(undoText());
+    emit redoTextChanged(redoText());
+    emit cleanChanged(isClean());
+}
+
+void UndoStack::journalStep(int idx)
+{
+    QList<UndoCommand *> cmds = commands(idx);
+    for (int cmd=0; cmd < cmds.size(); cmd++)
+        cmds.at(cmd)->journal(_journal);
+}
+
+void UndoStack::moveJournal(const QSharedPointer<ChunkSpill> &journal)
+{
+    for (int idx=0; idx < count(); idx++)
+    {
+        QList<UndoCommand *> cmds = commands(idx);
+        for (int cmd=0; cmd < cmds.size(); cmd++)
+            cmds.at(cmd)->moveJournal(journal);
     }
 }
+
+QList<UndoCommand *> UndoStack::commands(int idx) const
+{
+    // Every step holds an UndoCommand, the remove and insert of an overwrite are its
+    // children. The commands belong to this stack, it may change them.
+    QList<UndoCommand *> result;
+    UndoCommand *cmd = static_cast<const UndoStep *>(command(idx))->command().data();
+    result.append(cmd);
+    for (int child=0; child < cmd->childCount(); child++)
+        result.append(static_cast<UndoCommand *>(const_cast<QUndoCommand *>(cmd->child(child))));
+    return result;
+}
+
+#ifdef MODUL_TEST
+void UndoStack::waitForPool()
+{
+    _pool.waitForDone();
+    limit();
+}
+
+ChunkSpill *UndoStack::journalFile()
+{
+    return _journal.data();
+}
+
+#endif
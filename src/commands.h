@@ -3,9 +3,15 @@
 
 /** \cond docNever */
 
+#include <QThreadPool>
 #include <QUndoStack>
 
 #include "chunks.h"
+#include "chunkspill.h"
+
+// Bytes a removed or overwritten range may have at most, its old data is kept in a
+// QByteArray for undo, which holds less than 2 GiB
+#define UNDO_RANGE_MAX 0x7fffffe0
 
 /*! CharCommand is a class to provid undo/redo functionality in QHexEdit.
 A QUndoCommand represents a single editing action on a document. CharCommand
@@ -20,26 +26,89 @@ If you for example insert a new byt "34" this means for the editor doing 3
 steps: insert a "00", overwrite it with "03" and the overwrite it with "34". These
 3 steps are combined into a single step, insert a "34".
 
-The byte array oriented commands are just put into a set of single byte commands,
-which are pooled together with the macroBegin() and macroEnd() functionality of
-Qt's QUndoStack.
+The byte array oriented commands (InsertRangeCommand, RemoveRangeCommand and
+OverwriteRangeCommand) store the affected bytes only once and apply them with the
+byte array manipulations of Chunks. The highlighting of the bytes they replace
+is kept as ChangedRanges. An overwrite, which changes the size of the data, is a
+remove and an insert, which are the children of one command. removeAt() and overwrite() do nothing
+for a range of more than UNDO_RANGE_MAX bytes, the caller has to refuse it visibly.
+
+ReplaceAllCommand replaces all occurences of a pattern as a single step. It keeps
+the positions in a MatchIndex and the highlighting of the replaced bytes, undo
+puts the pattern back at the positions of the replacements.
+
+The memory of the commands is limited by setMemoryBudget(). Beyond it, the bytes of
+all steps but the newest are compressed with qCompress() in a thread and are expanded
+again, when they are undone or redone. If this is not enough, the data of the oldest
+steps is dropped. As the newest step is never compressed, a single step bigger than
+the budget is dropped as soon as it is pushed. QUndoStack can not remove commands at
+the bottom, so every step is an UndoStep, which shares its command. The steps, which
+are kept, are pushed anew without doing them again, so neither QUndoStack::setIndex(),
+createUndoAction() nor QUndoView can reach a dropped step. The index 0 is no longer
+the unchanged data then, see trimmed(). The commands keep their memory usage up to
+date in UndoMemory, so it is never summed up.
+
+With setJournal(), the big data of the commands is appended to a journal, a ChunkSpill
+in a temporary file, only the places are kept in memory. Deleted and dropped steps
+leave garbage in it, when this gets too big, the journal is written anew.
 */
 
+class UndoCommand;
+struct UndoMemory;
+
 class UndoStack : public QUndoStack
 {
     Q_OBJECT
 
 public:
     UndoStack(Chunks *chunks, QObject * parent=0);
+    ~UndoStack();
     void insert(qint64 pos, char c);
     void insert(qint64 pos, const QByteArray &ba);
     void removeAt(qint64 pos, qint64 len=1);
     void overwrite(qint64 pos, char c);
-    void overwrite(qint64 pos, int len, const QByteArray &ba);
+    void overwrite(qint64 pos, qint64 len, const QByteArray &ba);
+    qint64 replaceAll(const QByteArray &ba, const QByteArray &replacement, qint64 from=0, qint64 to=-1);
+
+    // Bytes kept by the steps, which were not dropped. 0 means no limit (default)
+    void setMemoryBudget(qint64 memoryBudget);
+    qint64 memoryBudget();
+    qint64 memoryUsage();
+
+    bool trimmed() const;                       // steps were dropped since the last clear()
+
+    // Keeps the big data of the commands in a temporary file
+    void setJournal(bool journal);
+    bool journal();
+    qint64 journalSize();                       // bytes used in the file
+
+private slots:
+    void moved(int idx);                        // index changed, limits the memory
+    void limit();                               // journals, compresses and drops steps
 
 private:
+    void pushCommand(UndoCommand *command);     // as an UndoStep
+    void trim(int dropped);                     // pushes the steps anew without the dropped ones
+    void journalStep(int idx);
+    void moveJournal(const QSharedPointer<ChunkSpill> &journal);
+    QList<UndoCommand *> commands(int idx) const;
+
     Chunks * _chunks;
     QObject * _parent;
+    QThreadPool _pool;                          // compresses the commands
+    UndoMemory *_memory;
+    qint64 _memoryBudget;
+    int _index;                                 // index at the last moved()
+    int _compressed;                            // steps in front of it went to _pool
+    int _journaled;                             // steps in front of it are in the journal
+    bool _trimmed;
+    QSharedPointer<ChunkSpill> _journal;        // null, if the data is kept in memory
+
+#ifdef MODUL_TEST
+public:
+    void waitForPool();                         // compressions are done and collected
+    ChunkSpill *journalFile();
+#endif
 };
 
 /** \endcond docNever */
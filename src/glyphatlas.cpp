@@ -0,0 +1,131 @@
+#include "glyphatlas.h"
+
+#include <QFontMetrics>
+#include <QPaintDevice>
+
+// Layout of an atlas: 16 rows of 16 hex pairs, below 16 rows of 16 ascii chars
+#define CELLS_PER_ROW 16
+
+
+// ***************************************** Constructor, settings
+
+GlyphAtlas::GlyphAtlas()
+{
+    _charWidth = 0;
+    _charHeight = 0;
+    _ascent = 0;
+    _hexCaps = false;
+    _pixelRatio = 1;
+}
+
+void GlyphAtlas::setFont(const QFont &font, int charWidth, int charHeight)
+{
+    _font = font;
+    _charWidth = charWidth;
+    _charHeight = charHeight;
+    _ascent = QFontMetrics(font).ascent();
+    _atlases.clear();
+}
+
+void GlyphAtlas::setHexCaps(bool hexCaps)
+{
+    if (_hexCaps != hexCaps)
+    {
+        _hexCaps = hexCaps;
+        _atlases.clear();
+    }
+}
+
+
+// ***************************************** Painting
+
+void GlyphAtlas::addHex(int x, int y, uchar byte, const QColor &color)
+{
+    addCell(x, y, (byte % CELLS_PER_ROW) * 2 * _charWidth, (byte / CELLS_PER_ROW) * _charHeight,
+            2 * _charWidth, color);
+}
+
+void GlyphAtlas::addAscii(int x, int y, uchar byte, const QColor &color)
+{
+    addCell(x, y, (byte % CELLS_PER_ROW) * _charWidth, (CELLS_PER_ROW + byte / CELLS_PER_ROW) * _charHeight,
+            _charWidth, color);
+}
+
+void GlyphAtlas::flush(QPainter &painter)
+{
+    qreal pixelRatio = 1;
+#if QT_VERSION >= QT_VERSION_CHECK(5, 6, 0)
+    pixelRatio = painter.device()->devicePixelRatioF();
+#elif QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    pixelRatio = painter.device()->devicePixelRatio();
+#endif
+    if (pixelRatio != _pixelRatio)
+    {
+        _pixelRatio = pixelRatio;
+        _atlases.clear();
+    }
+
+    QHash<QRgb, QVector<QPainter::PixmapFragment> >::iterator it;
+    for (it = _fragments.begin(); it != _fragments.end(); ++it)
+    {
+        QVector<QPainter::PixmapFragment> &fragments = it.value();
+        if (fragments.isEmpty())
+            continue;
+
+        // Fragments are collected in logical pixels, the atlas may have more
+        if (_pixelRatio != 1)
+            for (int idx=0; idx < fragments.size(); idx++)
+            {
+                QPainter::PixmapFragment &f = fragments[idx];
+                f.sourceLeft *= _pixelRatio;
+                f.sourceTop *= _pixelRatio;
+                f.width *= _pixelRatio;
+                f.height *= _pixelRatio;
+                f.scaleX = 1 / _pixelRatio;
+                f.scaleY = 1 / _pixelRatio;
+            }
+        painter.drawPixmapFragments(fragments.constData(), fragments.size(), atlas(it.key()));
+        fragments.resize(0);
+    }
+}
+
+
+// ***************************************** Private utility functions
+
+void GlyphAtlas::addCell(int x, int y, int atlasX, int atlasY, int width, const QColor &color)
+{
+    // Fragments are positioned by their center
+    _fragments[color.rgba()].append(QPainter::PixmapFragment::create(
+            QPointF(x + width / 2., y - _ascent + _charHeight / 2.),
+            QRectF(atlasX, atlasY, width, _charHeight)));
+}
+
+const QPixmap &GlyphAtlas::atlas(QRgb color)
+{
+    QHash<QRgb, QPixmap>::iterator it = _atlases.find(color);
+    if (it != _atlases.end())
+        return it.value();
+
+    QSize size(2 * CELLS_PER_ROW * _charWidth, 2 * CELLS_PER_ROW * _charHeight);
+    QPixmap pixmap(size * _pixelRatio);
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    pixmap.setDevicePixelRatio(_pixelRatio);
+#endif
+    pixmap.fill(Qt::transparent);
+
+    QPainter painter(&pixmap);
+    painter.setFont(_font);
+    painter.setPen(QColor::fromRgba(color));
+    for (int byte=0; byte < 256; byte++)
+    {
+        QString hex = QString("%1").arg(byte, 2, 16, QChar('0'));
+        int ch = byte < 0x20 ? '.' : byte;
+        int col = byte % CELLS_PER_ROW;
+        int row = byte / CELLS_PER_ROW;
+        painter.drawText(col * 2 * _charWidth, row * _charHeight + _ascent, _hexCaps ? hex.toUpper() : hex);
+        painter.drawText(col * _charWidth, (CELLS_PER_ROW + row) * _charHeight + _ascent, QString(QChar(ch)));
+    }
+    painter.end();
+
+    return _atlases.insert(color, pixmap).value();
+}
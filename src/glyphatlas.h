@@ -0,0 +1,49 @@
+#ifndef GLYPHATLAS_H
+#define GLYPHATLAS_H
+
+/** \cond docNever */
+
+/*! GlyphAtlas paints the hex and ascii cells of QHexEdit out of pixmaps.
+ *
+ * The 256 hex pairs and the 256 ascii chars are rendered once per text color into
+ * a pixmap, the atlas. Painting a cell copies a small rectangle out of it, so no
+ * text is laid out while painting. The cells of a frame are collected with addHex()
+ * and addAscii(), flush() draws them with one drawPixmapFragments() call per color.
+ * A new font, hex caps or device pixel ratio discards the atlases.
+ */
+
+#include <QtCore>
+#include <QColor>
+#include <QFont>
+#include <QPainter>
+#include <QPixmap>
+
+class GlyphAtlas
+{
+public:
+    GlyphAtlas();
+    void setFont(const QFont &font, int charWidth, int charHeight);
+    void setHexCaps(bool hexCaps);
+
+    // Cells are placed like QPainter::drawText(x, y, text), y is the baseline
+    void addHex(int x, int y, uchar byte, const QColor &color);
+    void addAscii(int x, int y, uchar byte, const QColor &color);
+    void flush(QPainter &painter);
+
+private:
+    void addCell(int x, int y, int atlasX, int atlasY, int width, const QColor &color);
+    const QPixmap &atlas(QRgb color);
+
+    QFont _font;
+    int _charWidth;
+    int _charHeight;
+    int _ascent;
+    bool _hexCaps;
+    qreal _pixelRatio;
+    QHash<QRgb, QPixmap> _atlases;
+    QHash<QRgb, QVector<QPainter::PixmapFragment> > _fragments;
+};
+
+/** \endcond docNever */
+
+#endif // GLYPHATLAS_H
@@ -0,0 +1,171 @@
+#include "matchindex.h"
+
+#define BLOCK_COUNT 64
+
+
+// ***************************************** Constructor
+
+MatchIndex::MatchIndex()
+{
+    clear();
+}
+
+void MatchIndex::clear()
+{
+    _blockStarts.clear();
+    _blockOffsets.clear();
+    _deltas.clear();
+    _count = 0;
+    _last = -1;
+}
+
+
+// ***************************************** Filling the index
+
+void MatchIndex::append(qint64 pos)
+{
+    if ((_count % BLOCK_COUNT) == 0)
+    {
+        _blockStarts.append(pos);
+        _blockOffsets.append(_deltas.size());
+    }
+    else
+    {
+        quint64 delta = (quint64)(pos - _last);
+        while (delta >= 0x80)
+        {
+            _deltas.append(char((delta & 0x7f) | 0x80));
+            delta >>= 7;
+        }
+        _deltas.append(char(delta));
+    }
+    _last = pos;
+    _count += 1;
+}
+
+void MatchIndex::append(const MatchIndex &matches)
+{
+    qint64 positions[BLOCK_COUNT];
+    for (int block=0; block < matches._blockStarts.size(); block++)
+    {
+        int count = matches.decodeBlock(block, positions);
+        for (int idx=0; idx < count; idx++)
+            append(positions[idx]);
+    }
+}
+
+
+// ***************************************** Information
+
+qint64 MatchIndex::count() const
+{
+    return _count;
+}
+
+qint64 MatchIndex::memoryUsage() const
+{
+    return _deltas.capacity() + _blockStarts.capacity() * (qint64)sizeof(qint64)
+            + _blockOffsets.capacity() * (qint64)sizeof(int);
+}
+
+
+// ***************************************** Lookup
+
+qint64 MatchIndex::next(qint64 pos) const
+{
+    if ((_count == 0) || (pos > _last))
+        return -1;
+    int block = blockOf(pos);
+    if (block < 0)
+        return _blockStarts.first();
+
+    qint64 positions[BLOCK_COUNT];
+    int count = decodeBlock(block, positions);
+    for (int idx=0; idx < count; idx++)
+        if (positions[idx] >= pos)
+            return positions[idx];
+    return _blockStarts.at(block + 1);
+}
+
+qint64 MatchIndex::previous(qint64 pos) const
+{
+    int block = blockOf(pos - 1);
+    if (block < 0)
+        return -1;
+
+    qint64 positions[BLOCK_COUNT];
+    int count = decodeBlock(block, positions);
+    for (int idx=count - 1; idx >= 0; idx--)
+        if (positions[idx] < pos)
+            return positions[idx];
+    return -1;
+}
+
+QVector<qint64> MatchIndex::range(qint64 from, qint64 to) const
+{
+    QVector<qint64> result;
+    qint64 positions[BLOCK_COUNT];
+    for (int block = qMax(blockOf(from), 0); block < _blockStarts.size(); block++)
+    {
+        if (_blockStarts.at(block) >= to)
+            break;
+        int count = decodeBlock(block, positions);
+        for (int idx=0; idx < count; idx++)
+            if ((positions[idx] >= from) && (positions[idx] < to))
+                result.append(positions[idx]);
+    }
+    return result;
+}
+
+int MatchIndex::blockCount() const
+{
+    return _blockStarts.size();
+}
+
+QVector<qint64> MatchIndex::block(int block) const
+{
+    QVector<qint64> result(BLOCK_COUNT);
+    result.resize(decodeBlock(block, result.data()));
+    return result;
+}
+
+
+// ***************************************** Private utility functions
+
+int MatchIndex::blockOf(qint64 pos) const
+{
+    // Last block, which starts at or in front of pos, -1 if there is none
+    int lo = 0;
+    int hi = _blockStarts.size() - 1;
+    if ((hi < 0) || (_blockStarts.at(0) > pos))
+        return -1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (_blockStarts.at(mid) <= pos)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+int MatchIndex::decodeBlock(int block, qint64 *positions) const
+{
+    int count = (int)qMin<qint64>(_count - (qint64)block * BLOCK_COUNT, BLOCK_COUNT);
+    const uchar *delta = (const uchar *)_deltas.constData() + _blockOffsets.at(block);
+    positions[0] = _blockStarts.at(block);
+    for (int idx=1; idx < count; idx++)
+    {
+        quint64 value = 0;
+        int shift = 0;
+        while (*delta & 0x80)
+        {
+            value |= (quint64)(*delta++ & 0x7f) << shift;
+            shift += 7;
+        }
+        value |= (quint64)(*delta++) << shift;
+        positions[idx] = positions[idx - 1] + (qint64)value;
+    }
+    return count;
+}
@@ -0,0 +1,54 @@
+#ifndef MATCHINDEX_H
+#define MATCHINDEX_H
+
+/** \cond docNever */
+
+/*! MatchIndex keeps the sorted positions of all matches of a search.
+ *
+ * The positions are stored in blocks of BLOCK_COUNT. Every block keeps its first
+ * position as it is, the following ones as differences to their predecessor in a
+ * variable length encoding (7 bits per byte). Close matches cost one or two bytes
+ * instead of eight. A binary search over the first positions of the blocks finds
+ * the block of any position in O(log n), only this block has to be decoded.
+ */
+
+#include <QtCore>
+
+class MatchIndex
+{
+public:
+    MatchIndex();
+    void clear();
+
+    // Positions have to be appended in ascending order
+    void append(qint64 pos);
+    void append(const MatchIndex &matches);
+
+    qint64 count() const;
+    qint64 memoryUsage() const;
+
+    // First match at or behind pos, last match in front of pos, -1 if there is none
+    qint64 next(qint64 pos) const;
+    qint64 previous(qint64 pos) const;
+
+    // All matches in from .. to - 1
+    QVector<qint64> range(qint64 from, qint64 to) const;
+
+    // Sequential access, block by block
+    int blockCount() const;
+    QVector<qint64> block(int block) const;
+
+private:
+    int blockOf(qint64 pos) const;
+    int decodeBlock(int block, qint64 *positions) const;
+
+    QVector<qint64> _blockStarts;               // first position of every block
+    QVector<int> _blockOffsets;                 // start of the differences in _deltas
+    QByteArray _deltas;
+    qint64 _count;
+    qint64 _last;
+};
+
+/** \endcond docNever */
+
+#endif // MATCHINDEX_H
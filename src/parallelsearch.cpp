@@ -0,0 +1,314 @@
+#include "parallelsearch.h"
+
+#define SEGMENT_SIZE 0x400000
+#define READ_SIZE 0x100000
+
+
+// ***************************************** Reading the snapshot in a thread
+
+class SnapshotReader: public SearchSource
+{
+public:
+    SnapshotReader(const ChunksSnapshot &snapshot, const uchar *map, qint64 mapSize)
+        : _snapshot(snapshot), _map(map), _mapSize(mapSize)
+    {
+    }
+
+    qint64 readSegment(qint64 pos, qint64 maxSize, bool backward, const char *&segment, QByteArray &buffer)
+    {
+        // Binary search of the last piece starting at lookup
+        const QVector<SnapshotPiece> &pieces = _snapshot.pieces;
+        qint64 lookup = backward ? pos - 1 : pos;
+        int lo = 0;
+        int hi = pieces.size() - 1;
+        while (lo < hi)
+        {
+            int mid = (lo + hi + 1) / 2;
+            if (pieces.at(mid).pos <= lookup)
+                lo = mid;
+            else
+                hi = mid - 1;
+        }
+        if ((hi < 0) || (lookup < pieces.at(lo).pos) || (lookup >= (pieces.at(lo).pos + pieces.at(lo).size)))
+            return 0;
+
+        const SnapshotPiece &piece = pieces.at(lo);
+        qint64 start, end;
+        if (backward)
+        {
+            start = qMax(piece.pos, pos - maxSize);
+            end = pos;
+        }
+        else
+        {
+            start = pos;
+            end = qMin(piece.pos + piece.size, pos + maxSize);
+        }
+
+        if (piece.spillPos >= 0)
+        {
+            buffer = _snapshot.spill->read(piece.spillPos + (start - piece.pos), (int)(end - start));
+            segment = buffer.constData();
+            return (buffer.size() == (end - start)) ? end - start : 0;
+        }
+        if (piece.srcPos < 0)
+        {
+            segment = piece.data.constData() + (start - piece.pos);
+            return end - start;
+        }
+
+        qint64 srcStart = piece.srcPos + (start - piece.pos);
+        qint64 srcSize = _map ? _mapSize : _snapshot.buffer.size();
+        if (_map || _snapshot.fileName.isEmpty())
+        {
+            if ((srcStart + (end - start)) > srcSize)
+                return 0;                       // source was truncated externally
+            segment = (_map ? (const char *)_map : _snapshot.buffer.constData()) + srcStart;
+            return end - start;
+        }
+
+        if ((end - start) > READ_SIZE)
+        {
+            if (backward)
+            {
+                start = end - READ_SIZE;
+                srcStart = piece.srcPos + (start - piece.pos);
+            }
+            else
+                end = start + READ_SIZE;
+        }
+        if (!_file.isOpen())
+        {
+            _file.setFileName(_snapshot.fileName);
+            if (!_file.open(QIODevice::ReadOnly))
+                return 0;
+        }
+        buffer.resize((int)(end - start));
+        _file.seek(srcStart);
+        if (_file.read(buffer.data(), end - start) < (end - start))
+            return 0;
+        segment = buffer.constData();
+        return end - start;
+    }
+
+private:
+    const ChunksSnapshot &_snapshot;
+    const uchar *_map;
+    qint64 _mapSize;
+    QFile _file;
+};
+
+class SearchWorker: public QRunnable
+{
+public:
+    SearchWorker(ParallelSearch *search)
+    {
+        _search = search;
+    }
+
+    void run()
+    {
+        _search->work();
+        _search->workerFinished();
+    }
+
+private:
+    ParallelSearch *_search;
+};
+
+
+// ***************************************** Constructor, destructor
+
+ParallelSearch::ParallelSearch(const ChunksSnapshot &snapshot, const QByteArray &pattern, QThreadPool *pool)
+    : _snapshot(snapshot), _engine(pattern)
+{
+    _pool = pool ? pool : QThreadPool::globalInstance();
+    _map = 0;
+    _mapSize = 0;
+    _canceled = false;
+    _backward = false;
+    _findAll = false;
+    _segmentMatches = 0;
+    _from = 0;
+    _starts = 0;
+    _segmentSize = SEGMENT_SIZE;
+    _segmentCount = 0;
+    _nextSegment = 0;
+    _running = 0;
+    _result = -1;
+    _scanned = 0;
+
+    // The mapping of Chunks belongs to the GUI thread, so the file is mapped again
+    if (_snapshot.memoryMapped && !_snapshot.fileName.isEmpty())
+    {
+        _file.setFileName(_snapshot.fileName);
+        if (_file.open(QIODevice::ReadOnly))
+        {
+            _mapSize = _file.size();
+            if (_mapSize > 0)
+                _map = _file.map(0, _mapSize);
+            if (!_map)
+            {
+                _mapSize = 0;
+                _file.close();
+            }
+        }
+    }
+}
+
+ParallelSearch::~ParallelSearch()
+{
+    if (_map)
+        _file.unmap(const_cast<uchar *>(_map));
+}
+
+
+// ***************************************** Search functions
+
+qint64 ParallelSearch::indexOf(qint64 from)
+{
+    return search(qMax<qint64>(from, 0), _snapshot.size, false);
+}
+
+qint64 ParallelSearch::lastIndexOf(qint64 from)
+{
+    return search(0, qMin(from, _snapshot.size), true);
+}
+
+qint64 ParallelSearch::indexAll(MatchIndex &matches)
+{
+    QVector<MatchIndex> segmentMatches((int)((_snapshot.size + _segmentSize - 1) / _segmentSize));
+    _segmentMatches = segmentMatches.data();
+    _findAll = true;
+    search(0, _snapshot.size, false);
+    _findAll = false;
+    _segmentMatches = 0;
+
+    qint64 count = 0;
+    if (!canceled())
+        for (int idx=0; idx < segmentMatches.size(); idx++)
+        {
+            matches.append(segmentMatches.at(idx));
+            count += segmentMatches.at(idx).count();
+        }
+    return count;
+}
+
+
+// ***************************************** Control and progress
+
+void ParallelSearch::cancel()
+{
+    QMutexLocker locker(&_mutex);
+    _canceled = true;
+}
+
+bool ParallelSearch::canceled()
+{
+    QMutexLocker locker(&_mutex);
+    return _canceled;
+}
+
+qint64 ParallelSearch::scanned()
+{
+    QMutexLocker locker(&_mutex);
+    return _scanned;
+}
+
+qint64 ParallelSearch::total()
+{
+    QMutexLocker locker(&_mutex);
+    return _starts;
+}
+
+void ParallelSearch::setSegmentSize(qint64 segmentSize)
+{
+    QMutexLocker locker(&_mutex);
+    _segmentSize = qMax<qint64>(segmentSize, 1);
+}
+
+
+// ***************************************** Private utility functions
+
+qint64 ParallelSearch::search(qint64 from, qint64 to, bool backward)
+{
+    // Matches have to lie completely inside from .. to - 1
+    if (!_snapshot.valid || (_engine.size() == 0) || ((to - from) < _engine.size()))
+        return -1;
+
+    int workers;
+    {
+        QMutexLocker locker(&_mutex);
+        if (_canceled)
+            return -1;
+        _backward = backward;
+        _from = from;
+        _starts = to - from - _engine.size() + 1;
+        _segmentCount = (_starts + _segmentSize - 1) / _segmentSize;
+        _nextSegment = 0;
+        _result = -1;
+        _scanned = 0;
+        workers = (int)qMin<qint64>(_pool->maxThreadCount(), _segmentCount) - 1;
+        _running = workers;
+    }
+
+    // The calling thread works too, so the search ends even with a busy pool
+    for (int idx=0; idx < workers; idx++)
+        _pool->start(new SearchWorker(this));
+    work();
+
+    QMutexLocker locker(&_mutex);
+    while (_running > 0)
+        _workersDone.wait(&_mutex);
+    return _canceled ? -1 : _result;
+}
+
+void ParallelSearch::work()
+{
+    SnapshotReader reader(_snapshot, _map, _mapSize);
+    const int overlap = _engine.size() - 1;
+
+    forever
+    {
+        // Segments behind a match can not give a better one
+        _mutex.lock();
+        bool done = _canceled || ((_result >= 0) && !_findAll) || (_nextSegment >= _segmentCount);
+        qint64 segment = _nextSegment++;
+        _mutex.unlock();
+        if (done)
+            break;
+
+        qint64 start, end;
+        if (_backward)
+        {
+            end = _from + _starts - segment * _segmentSize;
+            start = qMax(_from, end - _segmentSize);
+        }
+        else
+        {
+            start = _from + segment * _segmentSize;
+            end = qMin(start + _segmentSize, _from + _starts);
+        }
+
+        qint64 found = -1;
+        if (_findAll)
+            _engine.indexAll(reader, start, end + overlap, _segmentMatches[segment]);
+        else if (_backward)
+            found = _engine.lastIndexIn(reader, start, end + overlap);
+        else
+            found = _engine.indexIn(reader, start, end + overlap);
+
+        _mutex.lock();
+        if ((found >= 0) && ((_result < 0) || (_backward ? (found > _result) : (found < _result))))
+            _result = found;
+        _scanned += end - start;
+        _mutex.unlock();
+    }
+}
+
+void ParallelSearch::workerFinished()
+{
+    QMutexLocker locker(&_mutex);
+    _running -= 1;
+    _workersDone.wakeAll();
+}
@@ -0,0 +1,82 @@
+#ifndef PARALLELSEARCH_H
+#define PARALLELSEARCH_H
+
+/** \cond docNever */
+
+/*! ParallelSearch searches a snapshot of Chunks with several threads.
+ *
+ * The range is split into segments of some megabytes, every segment is searched
+ * together with the first pattern size - 1 bytes of the next one, so no match is lost
+ * at the borders. The segments are handed out in search order to the threads of a
+ * QThreadPool, the calling thread works on them too. When a match is found, no
+ * further segments are handed out, the running ones are finished and the lowest
+ * (forward) or highest (backward) match wins. indexAll() collects the matches of
+ * every segment on its own and joins them in the end.
+ *
+ * Every thread reads the source on its own: a file by its name or its mapping,
+ * a QBuffer out of its shared data. cancel(), scanned() and total() may be called
+ * from any thread.
+ */
+
+#include <QtCore>
+#include <QFile>
+#include <QMutex>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+#include "chunks.h"
+
+class ParallelSearch
+{
+public:
+    ParallelSearch(const ChunksSnapshot &snapshot, const QByteArray &pattern, QThreadPool *pool=0);
+    ~ParallelSearch();
+
+    // Same results as Chunks::indexOf() and Chunks::lastIndexOf()
+    qint64 indexOf(qint64 from);
+    qint64 lastIndexOf(qint64 from);
+
+    // Finds all matches, returns their number
+    qint64 indexAll(MatchIndex &matches);
+
+    // Control and progress
+    void cancel();
+    bool canceled();
+    qint64 scanned();
+    qint64 total();
+    void setSegmentSize(qint64 segmentSize);
+
+private:
+    Q_DISABLE_COPY(ParallelSearch)
+    friend class SearchWorker;
+
+    qint64 search(qint64 from, qint64 to, bool backward);
+    void work();
+    void workerFinished();
+
+    ChunksSnapshot _snapshot;
+    SearchEngine _engine;
+    QThreadPool *_pool;
+    QFile _file;                                // mapped source
+    const uchar *_map;
+    qint64 _mapSize;
+
+    QMutex _mutex;                              // guards all of the following
+    QWaitCondition _workersDone;
+    bool _canceled;
+    bool _backward;
+    bool _findAll;
+    MatchIndex *_segmentMatches;                // one index per segment for indexAll()
+    qint64 _from;
+    qint64 _starts;                             // number of possible match positions
+    qint64 _segmentSize;
+    qint64 _segmentCount;
+    qint64 _nextSegment;
+    int _running;                               // workers in the pool
+    qint64 _result;
+    qint64 _scanned;
+};
+
+/** \endcond docNever */
+
+#endif // PARALLELSEARCH_H
@@ -3,10 +3,25 @@
 #include <QKeyEvent>
 #include <QPainter>
 #include <QScrollBar>
+#include <QWheelEvent>
 
 #include "qhexedit.h"
+#include "parallelsearch.h"
+#include "viewloader.h"
 #include <algorithm>
 
+// More lines than this are scaled onto the range of the vertical scroll bar
+#define SCROLL_RANGE 0x40000000
+
+
+// Compares the bytes begin .. begin + len - 1 of two buffers, missing ones included
+static bool rowDiffers(const QByteArray &a, const QByteArray &b, int begin, int len)
+{
+    int lenA = qBound(0, a.size() - begin, len);
+    int lenB = qBound(0, b.size() - begin, len);
+    return (lenA != lenB) || ((lenA > 0) && (memcmp(a.constData() + begin, b.constData() + begin, lenA) != 0));
+}
+
 
 // ********************************************************************** Constructor, destructor
 
@@ -19,15 +34,34 @@ QHexEdit::QHexEdit(QWidget *parent) : QAbstractScrollArea(parent)
     _highlighting = true;
     _readOnly = false;
     _cursorPosition = 0;
+    _bPosFirst = 0;
+    _bPosLast = 0;
+    _bPosShown = 0;
+    _pxPosHexX = 0;
+    _bPosLoaded = -1;
+    _asyncLoading = false;
+    _bSelectionBegin = 0;
+    _bSelectionEnd = 0;
+    _bSelectionInit = 0;
+    _dataShownValid = false;
+    _topLineMax = 0;
+    _scrollScale = 1;
     _lastEventSize = 0;
     _hexCharsInLine = 47;
     _bytesPerLine = 16;
     _editAreaIsAscii = false;
     _hexCaps = false;
     _dynamicBytesPerLine = false;
+    _parallelSearch = false;
+    _glyphAtlas = true;
+    _matchSize = 0;
+    _editDepth = 0;
+    _editDataChanged = false;
+    _editRefresh = false;
 
     _chunks = new Chunks(this);
     _undoStack = new UndoStack(_chunks, this);
+    _loader = new ViewLoader(this);
 #ifdef Q_OS_WIN32
     setFont(QFont("Courier", 10));
 #else
@@ -35,12 +69,16 @@ QHexEdit::QHexEdit(QWidget *parent) : QAbstractScrollArea(parent)
 #endif
     setAddressAreaColor(this->palette().alternateBase().color());
     setHighlightingColor(QColor(0xff, 0xff, 0x99, 0xff));
+    setMatchColor(QColor(0xff, 0xa5, 0x00, 0xff));
     setSelectionColor(this->palette().highlight().color());
 
     connect(&_cursorTimer, SIGNAL(timeout()), this, SLOT(updateCursor()));
-    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(adjust()));
-    connect(horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(adjust()));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(scrollVertical(int)));
+    connect(verticalScrollBar(), SIGNAL(actionTriggered(int)), this, SLOT(scrollAction(int)));
+    connect(horizontalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(scrollHorizontal(int)));
     connect(_undoStack, SIGNAL(indexChanged(int)), this, SLOT(dataChangedPrivate(int)));
+    connect(_chunks, SIGNAL(contentsChanged(qint64,qint64,qint64)), this, SLOT(contentsChangedPrivate(qint64,qint64,qint64)));
+    connect(_loader, SIGNAL(loaded(qint64,QByteArray,QByteArray)), this, SLOT(viewLoaded(qint64,QByteArray,QByteArray)));
 
     _cursorTimer.setInterval(500);
     _cursorTimer.start();
@@ -167,7 +205,8 @@ void QHexEdit::setCursorPosition(qint64 position)
 
     // 3. Calc new position of cursor
     _bPosCurrent = position / 2;
-    _pxCursorY = ((position / 2 - _bPosFirst) / _bytesPerLine + 1) * _pxCharHeight;
+    qint64 pxCursorY = ((position / 2 - _bPosFirst) / _bytesPerLine + 1) * _pxCharHeight;
+    _pxCursorY = (int)qBound<qint64>(-_pxCharHeight, pxCursorY, viewport()->height() + _pxCharHeight);
     int x = (position % (2 * _bytesPerLine));
     if (_editAreaIsAscii)
     {
@@ -254,6 +293,18 @@ QColor QHexEdit::highlightingColor()
     return _brushHighlighted.color();
 }
 
+void QHexEdit::setMatchColor(const QColor &color)
+{
+    _brushMatch = QBrush(color);
+    _penMatch = QPen(viewport()->palette().color(QPalette::WindowText));
+    viewport()->update();
+}
+
+QColor QHexEdit::matchColor()
+{
+    return _brushMatch.color();
+}
+
 void QHexEdit::setOverwriteMode(bool overwriteMode)
 {
     _overwriteMode = overwriteMode;
@@ -292,6 +343,7 @@ void QHexEdit::setHexCaps(const bool isCaps)
     if (_hexCaps != isCaps)
     {
         _hexCaps = isCaps;
+        _atlas.setHexCaps(isCaps);
         viewport()->update();
     }
 }
@@ -331,6 +383,167 @@ bool QHexEdit::write(QIODevice &iODevice, qint64 pos, qint64 count)
     return _chunks->write(iODevice, pos, count);
 }
 
+bool QHexEdit::writeChanges(QIODevice &iODevice)
+{
+    return _chunks->writeChanges(iODevice);
+}
+
+bool QHexEdit::setMemoryMapped(bool memoryMapped)
+{
+    return _chunks->setMemoryMapped(memoryMapped);
+}
+
+bool QHexEdit::memoryMapped()
+{
+    return _chunks->memoryMapped();
+}
+
+void QHexEdit::setKeepOpen(bool keepOpen)
+{
+    _chunks->setKeepOpen(keepOpen);
+}
+
+bool QHexEdit::keepOpen()
+{
+    return _chunks->keepOpen();
+}
+
+void QHexEdit::setCacheSize(qint64 cacheSize, int blockSize)
+{
+    _chunks->setCacheSize(cacheSize, blockSize);
+}
+
+qint64 QHexEdit::cacheSize()
+{
+    return _chunks->cacheSize();
+}
+
+qint64 QHexEdit::cacheHits()
+{
+    return _chunks->cacheHits();
+}
+
+qint64 QHexEdit::cacheMisses()
+{
+    return _chunks->cacheMisses();
+}
+
+void QHexEdit::setMemoryBudget(qint64 memoryBudget)
+{
+    _chunks->setMemoryBudget(memoryBudget);
+}
+
+qint64 QHexEdit::memoryBudget()
+{
+    return _chunks->memoryBudget();
+}
+
+qint64 QHexEdit::residentSize()
+{
+    return _chunks->residentSize();
+}
+
+qint64 QHexEdit::spilledSize()
+{
+    return _chunks->spilledSize();
+}
+
+void QHexEdit::setUndoMemoryBudget(qint64 memoryBudget)
+{
+    _undoStack->setMemoryBudget(memoryBudget);
+}
+
+qint64 QHexEdit::undoMemoryBudget()
+{
+    return _undoStack->memoryBudget();
+}
+
+qint64 QHexEdit::undoMemoryUsage()
+{
+    return _undoStack->memoryUsage();
+}
+
+void QHexEdit::setUndoJournal(bool undoJournal)
+{
+    _undoStack->setJournal(undoJournal);
+}
+
+bool QHexEdit::undoJournal()
+{
+    return _undoStack->journal();
+}
+
+void QHexEdit::setParallelSearch(bool parallelSearch)
+{
+    _parallelSearch = parallelSearch;
+}
+
+bool QHexEdit::parallelSearch()
+{
+    return _parallelSearch;
+}
+
+void QHexEdit::setAsyncLoading(bool asyncLoading)
+{
+    if (_asyncLoading != asyncLoading)
+    {
+        _asyncLoading = asyncLoading;
+        _loader->cancel();
+        _bPosLoaded = -1;
+        _dataShownValid = false;
+        readBuffers();
+    }
+}
+
+bool QHexEdit::asyncLoading()
+{
+    return _asyncLoading;
+}
+
+void QHexEdit::setPrefetchScreens(int prefetchScreens)
+{
+    _prefetch.setScreens(prefetchScreens);
+}
+
+int QHexEdit::prefetchScreens()
+{
+    return _prefetch.screens();
+}
+
+void QHexEdit::setPrefetchSize(qint64 prefetchSize)
+{
+    _prefetch.setBudget(prefetchSize);
+}
+
+qint64 QHexEdit::prefetchSize()
+{
+    return _prefetch.budget();
+}
+
+qint64 QHexEdit::prefetchHits()
+{
+    return _prefetch.hits();
+}
+
+qint64 QHexEdit::prefetchMisses()
+{
+    return _prefetch.misses();
+}
+
+void QHexEdit::setGlyphAtlas(bool glyphAtlas)
+{
+    if (_glyphAtlas != glyphAtlas)
+    {
+        _glyphAtlas = glyphAtlas;
+        viewport()->update();
+    }
+}
+
+bool QHexEdit::glyphAtlas()
+{
+    return _glyphAtlas;
+}
+
 // ********************************************************************** Char handling
 void QHexEdit::insert(qint64 index, char ch)
 {
@@ -340,6 +553,8 @@ void QHexEdit::insert(qint64 index, char ch)
 
 void QHexEdit::remove(qint64 index, qint64 len)
 {
+    if (!fitsByteArray(qMin(len, _chunks->size() - index)))
+        return;
     _undoStack->removeAt(index, len);
     refresh();
 }
@@ -359,35 +574,113 @@ void QHexEdit::insert(qint64 pos, const QByteArray &ba)
 
 void QHexEdit::replace(qint64 pos, qint64 len, const QByteArray &ba)
 {
+    // A replacement, which changes the size, is one step of a remove and an insert
+    if (!fitsByteArray(qMin(len, _chunks->size() - pos)))
+        return;
     _undoStack->overwrite(pos, len, ba);
     refresh();
 }
 
+qint64 QHexEdit::replaceAll(const QByteArray &ba, const QByteArray &replacement, qint64 from, qint64 to)
+{
+    qint64 count = _undoStack->replaceAll(ba, replacement, from, to);
+    refresh();
+    return count;
+}
+
+// ********************************************************************** Edit transactions
+void QHexEdit::beginEdit()
+{
+    _editDepth += 1;
+}
+
+void QHexEdit::endEdit()
+{
+    if (_editDepth <= 0)
+        return;
+    _editDepth -= 1;
+    if (_editDepth > 0)
+        return;
+    if (_editDataChanged)
+    {
+        _editDataChanged = false;
+        dataChangedPrivate();
+    }
+    if (_editRefresh)
+    {
+        _editRefresh = false;
+        refresh();
+    }
+}
+
 // ********************************************************************** Utility functions
 void QHexEdit::ensureVisible()
 {
     if (_cursorPosition < (_bPosFirst * 2))
-        verticalScrollBar()->setValue((int)(_cursorPosition / 2 / _bytesPerLine));
+        setTopLine(_cursorPosition / 2 / _bytesPerLine);
     if (_cursorPosition > ((_bPosFirst + (_rowsShown - 1)*_bytesPerLine) * 2))
-        verticalScrollBar()->setValue((int)(_cursorPosition / 2 / _bytesPerLine) - _rowsShown + 1);
+        setTopLine(_cursorPosition / 2 / _bytesPerLine - _rowsShown + 1);
     if (_pxCursorX < horizontalScrollBar()->value())
         horizontalScrollBar()->setValue(_pxCursorX);
     if ((_pxCursorX + _pxCharWidth) > (horizontalScrollBar()->value() + viewport()->width()))
         horizontalScrollBar()->setValue(_pxCursorX + _pxCharWidth - viewport()->width());
-    viewport()->update();
 }
 
 qint64 QHexEdit::indexOf(const QByteArray &ba, qint64 from)
 {
-    qint64 pos = _chunks->indexOf(ba, from);
+    qint64 pos;
+    ChunksSnapshot snapshot;
+    if (_parallelSearch)
+        snapshot = _chunks->snapshot();
+    if (_parallelSearch && snapshot.valid)
+        pos = ParallelSearch(snapshot, ba).indexOf(from);
+    else
+        pos = _chunks->indexOf(ba, from);
     if (pos > -1)
-    {
-        qint64 curPos = pos*2;
-        setCursorPosition(curPos + ba.length()*2);
-        resetSelection(curPos);
-        setSelection(curPos + ba.length()*2);
-        ensureVisible();
-    }
+        selectFound(pos, ba.length(), false);
+    return pos;
+}
+
+qint64 QHexEdit::findAll(const QByteArray &ba)
+{
+    _matches.clear();
+    _matchSize = ba.size();
+    ChunksSnapshot snapshot;
+    if (_parallelSearch)
+        snapshot = _chunks->snapshot();
+    if (_parallelSearch && snapshot.valid)
+        ParallelSearch(snapshot, ba).indexAll(_matches);
+    else
+        _chunks->indexAll(ba, _matches);
+    readBuffers();
+    return _matches.count();
+}
+
+void QHexEdit::clearMatches()
+{
+    _matches.clear();
+    readBuffers();
+}
+
+qint64 QHexEdit::matchCount()
+{
+    return _matches.count();
+}
+
+qint64 QHexEdit::nextMatch(qint64 from)
+{
+    qint64 pos = _matches.next(from);
+    if (pos > -1)
+        selectFound(pos, _matchSize, false);
+    return pos;
+}
+
+qint64 QHexEdit::previousMatch(qint64 from)
+{
+    // The occurence has to end in front of from
+    qint64 pos = _matches.previous(from - _matchSize + 1);
+    if (pos > -1)
+        selectFound(pos, _matchSize, true);
     return pos;
 }
 
@@ -398,15 +691,16 @@ bool QHexEdit::isModified()
 
 qint64 QHexEdit::lastIndexOf(const QByteArray &ba, qint64 from)
 {
-    qint64 pos = _chunks->lastIndexOf(ba, from);
+    qint64 pos;
+    ChunksSnapshot snapshot;
+    if (_parallelSearch)
+        snapshot = _chunks->snapshot();
+    if (_parallelSearch && snapshot.valid)
+        pos = ParallelSearch(snapshot, ba).lastIndexOf(from);
+    else
+        pos = _chunks->lastIndexOf(ba, from);
     if (pos > -1)
-    {
-        qint64 curPos = pos*2;
-        setCursorPosition(curPos - 1);
-        resetSelection(curPos);
-        setSelection(curPos + ba.length()*2);
-        ensureVisible();
-    }
+        selectFound(pos, ba.length(), true);
     return pos;
 }
 
@@ -433,9 +727,20 @@ void QHexEdit::setFont(const QFont &font)
     _pxGapHexAscii = 2 * _pxCharWidth;
     _pxCursorWidth = _pxCharHeight / 7;
     _pxSelectionSub = _pxCharHeight / 5;
+    _atlas.setFont(font, _pxCharWidth, _pxCharHeight);
     viewport()->update();
 }
 
+QHexEditSearch *QHexEdit::startIndexOf(const QByteArray &ba, qint64 from)
+{
+    return startSearch(ba, from, false);
+}
+
+QHexEditSearch *QHexEdit::startLastIndexOf(const QByteArray &ba, qint64 from)
+{
+    return startSearch(ba, from, true);
+}
+
 QString QHexEdit::toReadableString()
 {
     QByteArray ba = _chunks->data();
@@ -583,28 +888,30 @@ void QHexEdit::keyPressEvent(QKeyEvent *event)
         setSelection(pos);
     }
 
-    // Edit Commands
+    // Edit Commands, a command of some edits refreshes the view once. The transaction
+    // ends behind the other keys, so every key reads the view once at most.
+    beginEdit();
     if (!_readOnly)
     {
         /* Cut */
         if (event->matches(QKeySequence::Cut))
         {
-            QByteArray ba = _chunks->data(getSelectionBegin(), getSelectionEnd() - getSelectionBegin()).toHex();
-            for (qint64 idx = 32; idx < ba.size(); idx +=33)
-                ba.insert(idx, "\n");
-            QClipboard *clipboard = QApplication::clipboard();
-            clipboard->setText(ba);
-            if (_overwriteMode)
+            // The clipboard gets the hex text with a newline every 16 bytes as 16 bit chars
+            qint64 len = getSelectionEnd() - getSelectionBegin();
+            if (fitsByteArray(2 * (2 * len + len / 16)))
             {
-                qint64 len = getSelectionEnd() - getSelectionBegin();
-                replace(getSelectionBegin(), (int)len, QByteArray((int)len, char(0)));
-            }
-            else
-            {
-                remove(getSelectionBegin(), getSelectionEnd() - getSelectionBegin());
+                QByteArray ba = _chunks->data(getSelectionBegin(), len).toHex();
+                for (qint64 idx = 32; idx < ba.size(); idx +=33)
+                    ba.insert(idx, "\n");
+                QClipboard *clipboard = QApplication::clipboard();
+                clipboard->setText(ba);
+                if (_overwriteMode)
+                    replace(getSelectionBegin(), len, QByteArray((int)len, char(0)));
+                else
+                    remove(getSelectionBegin(), len);
+                setCursorPosition(2 * getSelectionBegin());
+                resetSelection(2 * getSelectionBegin());
             }
-            setCursorPosition(2 * getSelectionBegin());
-            resetSelection(2 * getSelectionBegin());
         } else
 
         /* Paste */
@@ -626,17 +933,18 @@ void QHexEdit::keyPressEvent(QKeyEvent *event)
         /* Delete char */
         if (event->matches(QKeySequence::Delete))
         {
-            if (getSelectionBegin() != getSelectionEnd())
+            qint64 len = getSelectionEnd() - getSelectionBegin();
+            if (len > 0)
             {
-                _bPosCurrent = getSelectionBegin();
-                if (_overwriteMode)
+                if (fitsByteArray(len))
                 {
-                    QByteArray ba = QByteArray(getSelectionEnd() - getSelectionBegin(), char(0));
-                    replace(_bPosCurrent, ba.size(), ba);
-                }
-                else
-                {
-                    remove(_bPosCurrent, getSelectionEnd() - getSelectionBegin());
+                    _bPosCurrent = getSelectionBegin();
+                    if (_overwriteMode)
+                        replace(_bPosCurrent, len, QByteArray((int)len, char(0)));
+                    else
+                        remove(_bPosCurrent, len);
+                    setCursorPosition(2 * _bPosCurrent);
+                    resetSelection(2 * _bPosCurrent);
                 }
             }
             else
@@ -645,28 +953,27 @@ void QHexEdit::keyPressEvent(QKeyEvent *event)
                     replace(_bPosCurrent, char(0));
                 else
                     remove(_bPosCurrent, 1);
+                setCursorPosition(2 * _bPosCurrent);
+                resetSelection(2 * _bPosCurrent);
             }
-            setCursorPosition(2 * _bPosCurrent);
-            resetSelection(2 * _bPosCurrent);
         } else
 
         /* Backspace */
         if ((event->key() == Qt::Key_Backspace) && (event->modifiers() == Qt::NoModifier))
         {
-            if (getSelectionBegin() != getSelectionEnd())
+            qint64 len = getSelectionEnd() - getSelectionBegin();
+            if (len > 0)
             {
-                _bPosCurrent = getSelectionBegin();
-                setCursorPosition(2 * _bPosCurrent);
-                if (_overwriteMode)
+                if (fitsByteArray(len))
                 {
-                    QByteArray ba = QByteArray(getSelectionEnd() - getSelectionBegin(), char(0));
-                    replace(_bPosCurrent, ba.size(), ba);
-                }
-                else
-                {
-                    remove(_bPosCurrent, getSelectionEnd() - getSelectionBegin());
+                    _bPosCurrent = getSelectionBegin();
+                    setCursorPosition(2 * _bPosCurrent);
+                    if (_overwriteMode)
+                        replace(_bPosCurrent, len, QByteArray((int)len, char(0)));
+                    else
+                        remove(_bPosCurrent, len);
+                    resetSelection(2 * _bPosCurrent);
                 }
-                resetSelection(2 * _bPosCurrent);
             }
             else
             {
@@ -713,18 +1020,19 @@ void QHexEdit::keyPressEvent(QKeyEvent *event)
             else
                 key = int(event->text()[0].toLower().toLatin1());
 
-            if ((((key >= '0' && key <= '9') || (key >= 'a' && key <= 'f')) && _editAreaIsAscii == false)
-                || (key >= ' ' && _editAreaIsAscii))
+            // Typing over a selection, which can not be removed, is refused as a whole
+            qint64 len = getSelectionEnd() - getSelectionBegin();
+            if (((((key >= '0' && key <= '9') || (key >= 'a' && key <= 'f')) && _editAreaIsAscii == false)
+                || (key >= ' ' && _editAreaIsAscii)) && fitsByteArray(len))
             {
-                if (getSelectionBegin() != getSelectionEnd())
+                if (len > 0)
                 {
                     if (_overwriteMode)
                     {
-                        qint64 len = getSelectionEnd() - getSelectionBegin();
-                        replace(getSelectionBegin(), (int)len, QByteArray((int)len, char(0)));
+                        replace(getSelectionBegin(), len, QByteArray((int)len, char(0)));
                     } else
                     {
-                        remove(getSelectionBegin(), getSelectionEnd() - getSelectionBegin());
+                        remove(getSelectionBegin(), len);
                         _bPosCurrent = getSelectionBegin();
                     }
                     setCursorPosition(2 * _bPosCurrent);
@@ -757,14 +1065,13 @@ void QHexEdit::keyPressEvent(QKeyEvent *event)
                 }
             }
         }
-
-
     }
 
     /* Copy */
-    if (event->matches(QKeySequence::Copy))
+    qint64 len = getSelectionEnd() - getSelectionBegin();
+    if (event->matches(QKeySequence::Copy) && fitsByteArray(2 * (2 * len + len / 16)))
     {
-        QByteArray ba = _chunks->data(getSelectionBegin(), getSelectionEnd() - getSelectionBegin()).toHex();
+        QByteArray ba = _chunks->data(getSelectionBegin(), len).toHex();
         for (qint64 idx = 32; idx < ba.size(); idx +=33)
             ba.insert(idx, "\n");
         QClipboard *clipboard = QApplication::clipboard();
@@ -791,12 +1098,12 @@ void QHexEdit::keyPressEvent(QKeyEvent *event)
     }
 
     refresh();
+    endEdit();
 }
 
 void QHexEdit::mouseMoveEvent(QMouseEvent * event)
 {
     _blink = false;
-    viewport()->update();
     qint64 actPos = cursorPosition(event->pos());
     if (actPos >= 0)
     {
@@ -808,7 +1115,6 @@ void QHexEdit::mouseMoveEvent(QMouseEvent * event)
 void QHexEdit::mousePressEvent(QMouseEvent * event)
 {
     _blink = false;
-    viewport()->update();
     qint64 cPos = cursorPosition(event->pos());
     if (cPos >= 0)
     {
@@ -824,7 +1130,9 @@ void QHexEdit::paintEvent(QPaintEvent *event)
 
     if (event->rect() != _cursorRect)
     {
-        int pxPosStartY = _pxCharHeight;
+        // Rows reach into the next one, so one more on top is painted
+        int firstRow = qMax(event->rect().top() / _pxCharHeight - 1, 0);
+        int lastRow = qMin(event->rect().bottom() / _pxCharHeight, _rowsShown);
 
         // draw some patterns if needed
         painter.fillRect(event->rect(), viewport()->palette().color(QPalette::Base));
@@ -843,69 +1151,114 @@ void QHexEdit::paintEvent(QPaintEvent *event)
         if (_addressArea)
         {
             QString address;
-            for (int row=0, pxPosY = _pxCharHeight; row <= (_dataShown.size()/_bytesPerLine); row++, pxPosY +=_pxCharHeight)
+            int lastAddressRow = qMin(lastRow, _dataShown.size()/_bytesPerLine);
+            for (int row=firstRow, pxPosY = (firstRow + 1) * _pxCharHeight; row <= lastAddressRow; row++, pxPosY +=_pxCharHeight)
             {
                 address = QString("%1").arg(_bPosFirst + row*_bytesPerLine + _addressOffset, _addrDigits, 16, QChar('0'));
                 painter.drawText(_pxPosAdrX - pxOfsX, pxPosY, address);
             }
         }
 
-        // paint hex and ascii area
-        QPen colStandard = QPen(viewport()->palette().color(QPalette::WindowText));
+        // paint hex and ascii area, a run of bytes with the same state gets one
+        // background rect and one text
+        enum { Standard, Selected, Match, Highlighted, Pending };
+        QPen pens[5] = { QPen(viewport()->palette().color(QPalette::WindowText)),
+                         _penSelection, _penMatch, _penHighlighted, QPen() };
+        QBrush brushes[5] = { viewport()->palette().color(QPalette::Base),
+                              _brushSelection.color(), _brushMatch.color(), _brushHighlighted.color(),
+                              QBrush(viewport()->palette().color(QPalette::Mid), Qt::Dense6Pattern) };
+        QByteArray states(_bytesPerLine, Standard);
 
         painter.setBackgroundMode(Qt::TransparentMode);
 
-        for (int row = 0, pxPosY = pxPosStartY; row <= _rowsShown; row++, pxPosY +=_pxCharHeight)
+        for (int row = firstRow, pxPosY = (firstRow + 1) * _pxCharHeight; row <= lastRow; row++, pxPosY +=_pxCharHeight)
         {
-            QByteArray hex;
             int pxPosX = _pxPosHexX  - pxOfsX;
             int pxPosAsciiX2 = _pxPosAsciiX  - pxOfsX;
             qint64 bPosLine = row * _bytesPerLine;
-            for (int colIdx = 0; ((bPosLine + colIdx) < _dataShown.size() && (colIdx < _bytesPerLine)); colIdx++)
+            int cols = (int)qMin<qint64>(_bytesPerLine, _dataShown.size() - bPosLine);
+            for (int colIdx = 0; colIdx < cols; colIdx++)
             {
-                QColor c = viewport()->palette().color(QPalette::Base);
-                painter.setPen(colStandard);
+                int idx = (int)bPosLine + colIdx;
+                qint64 posBa = _bPosFirst + idx;
+                if (_pendingShown.at(idx))
+                    states[colIdx] = Pending;
+                else if ((getSelectionBegin() <= posBa) && (getSelectionEnd() > posBa))
+                    states[colIdx] = Selected;
+                else if (_matchesShown.at(idx))
+                    states[colIdx] = Match;
+                else if (_highlighting && _markedShown.at(idx))
+                    states[colIdx] = Highlighted;
+                else
+                    states[colIdx] = Standard;
+            }
 
-                qint64 posBa = _bPosFirst + bPosLine + colIdx;
-                if ((getSelectionBegin() <= posBa) && (getSelectionEnd() > posBa))
+            int end;
+            for (int start = 0; start < cols; start = end)
+            {
+                int state = states.at(start);
+                end = start + 1;
+                while ((end < cols) && (states.at(end) == state))
+                    end++;
+                painter.setPen(pens[state]);
+
+                // render backgrounds, the base color is already there
+                int pxRunX = pxPosX + start * 3 * _pxCharWidth;
+                int pxRunAsciiX = pxPosAsciiX2 + start * _pxCharWidth;
+                if (state != Standard)
                 {
-                    c = _brushSelection.color();
-                    painter.setPen(_penSelection);
+                    int pxLeft = (start == 0) ? pxRunX : pxRunX - _pxCharWidth;
+                    int pxRight = pxPosX + (end - 1) * 3 * _pxCharWidth + 2 * _pxCharWidth;
+                    painter.fillRect(QRect(pxLeft, pxPosY - _pxCharHeight + _pxSelectionSub, pxRight - pxLeft, _pxCharHeight), brushes[state]);
+                    if (_asciiArea)
+                        painter.fillRect(QRect(pxRunAsciiX, pxPosY - _pxCharHeight + _pxSelectionSub, (end - start) * _pxCharWidth, _pxCharHeight), brushes[state]);
                 }
+                if (state == Pending)
+                    continue;                           // placeholders have no text
+
+                // render hex values
+                if (_glyphAtlas)
+                    for (int colIdx = start; colIdx < end; colIdx++)
+                        _atlas.addHex(pxPosX + colIdx * 3 * _pxCharWidth, pxPosY, (uchar)_dataShown.at((int)bPosLine + colIdx), pens[state].color());
                 else
                 {
-                    if (_highlighting)
-                        if (_markedShown.at((int)(posBa - _bPosFirst)))
-                        {
-                            c = _brushHighlighted.color();
-                            painter.setPen(_penHighlighted);
-                        }
+                    QByteArray hex;
+                    hex.reserve((end - start) * 3);
+                    for (int colIdx = start; colIdx < end; colIdx++)
+                    {
+                        if (colIdx > start)
+                            hex.append(' ');
+                        hex.append(_hexDataShown.constData() + (bPosLine + colIdx) * 2, 2);
+                    }
+                    painter.drawText(pxRunX, pxPosY, QString::fromLatin1(hexCaps() ? hex.toUpper() : hex));
                 }
 
-                // render hex value
-                QRect r;
-                if (colIdx == 0)
-                    r.setRect(pxPosX, pxPosY - _pxCharHeight + _pxSelectionSub, 2*_pxCharWidth, _pxCharHeight);
-                else
-                    r.setRect(pxPosX - _pxCharWidth, pxPosY - _pxCharHeight + _pxSelectionSub, 3*_pxCharWidth, _pxCharHeight);
-                painter.fillRect(r, c);
-                hex = _hexDataShown.mid((bPosLine + colIdx) * 2, 2);
-                painter.drawText(pxPosX, pxPosY, hexCaps()?hex.toUpper():hex);
-                pxPosX += 3*_pxCharWidth;
-
-                // render ascii value
+                // render ascii values, only plain ascii is laid out as one string
                 if (_asciiArea)
                 {
-                    int ch = (uchar)_dataShown.at(bPosLine + colIdx);
-                    if ( ch < 0x20 )
-                        ch = '.';
-                    r.setRect(pxPosAsciiX2, pxPosY - _pxCharHeight + _pxSelectionSub, _pxCharWidth, _pxCharHeight);
-                    painter.fillRect(r, c);
-                    painter.drawText(pxPosAsciiX2, pxPosY, QChar(ch));
-                    pxPosAsciiX2 += _pxCharWidth;
+                    QByteArray ascii = _dataShown.mid((int)bPosLine + start, end - start);
+                    bool plain = true;
+                    for (int colIdx = 0; colIdx < ascii.size(); colIdx++)
+                    {
+                        uchar ch = (uchar)ascii.at(colIdx);
+                        if (ch < 0x20)
+                            ascii[colIdx] = '.';
+                        else if (ch > 0x7e)
+                            plain = false;
+                    }
+                    if (_glyphAtlas)
+                        for (int colIdx = 0; colIdx < ascii.size(); colIdx++)
+                            _atlas.addAscii(pxRunAsciiX + colIdx * _pxCharWidth, pxPosY, (uchar)ascii.at(colIdx), pens[state].color());
+                    else if (plain)
+                        painter.drawText(pxRunAsciiX, pxPosY, QString::fromLatin1(ascii));
+                    else
+                        for (int colIdx = 0; colIdx < ascii.size(); colIdx++)
+                            painter.drawText(pxRunAsciiX + colIdx * _pxCharWidth, pxPosY, QChar((uchar)ascii.at(colIdx)));
                 }
             }
         }
+        if (_glyphAtlas)
+            _atlas.flush(painter);
         painter.setBackgroundMode(Qt::TransparentMode);
         painter.setPen(viewport()->palette().color(QPalette::WindowText));
     }
@@ -915,17 +1268,21 @@ void QHexEdit::paintEvent(QPaintEvent *event)
         painter.fillRect(_cursorRect, this->palette().color(QPalette::WindowText));
     else
     {
-        painter.fillRect(QRect(_pxCursorX - pxOfsX, _pxCursorY - _pxCharHeight, _pxCharWidth, _pxCharHeight), viewport()->palette().color(QPalette::Base));
-        if (_editAreaIsAscii) {
-            QByteArray ba = _dataShown.mid((_cursorPosition - _bPosFirst) / 2, 1);
-            if (ba != "")
-            {
-                if (ba.at(0) <= ' ')
-                    ba[0] = '.';
-                painter.drawText(_pxCursorX - pxOfsX, _pxCursorY, ba);
-            }
-        } else {
-            painter.drawText(_pxCursorX - pxOfsX, _pxCursorY, _hexDataShown.mid(_cursorPosition - _bPosFirst, 1));
+        // The cursor counts nibbles, the view bytes. A byte, which is still loading, is
+        // hatched like its placeholder, the zero in its place is not shown.
+        QRect cursorCell(_pxCursorX - pxOfsX, _pxCursorY - _pxCharHeight, _pxCharWidth, _pxCharHeight);
+        qint64 nibble = _cursorPosition - _bPosFirst * 2;
+        bool shown = (nibble >= 0) && (nibble < _hexDataShown.size());
+        painter.fillRect(cursorCell, viewport()->palette().color(QPalette::Base));
+        if (shown && _pendingShown.at((int)(nibble / 2)))
+            painter.fillRect(cursorCell, QBrush(viewport()->palette().color(QPalette::Mid), Qt::Dense6Pattern));
+        else if (shown && _editAreaIsAscii) {
+            QByteArray ba = _dataShown.mid((int)(nibble / 2), 1);
+            if (ba.at(0) <= ' ')
+                ba[0] = '.';
+            painter.drawText(_pxCursorX - pxOfsX, _pxCursorY, ba);
+        } else if (shown) {
+            painter.drawText(_pxCursorX - pxOfsX, _pxCursorY, _hexDataShown.mid((int)nibble, 1));
         }
     }
 
@@ -937,6 +1294,24 @@ void QHexEdit::paintEvent(QPaintEvent *event)
     }
 }
 
+void QHexEdit::wheelEvent(QWheelEvent *event)
+{
+    // A scaled scroll bar would turn every wheel step into thousands of lines
+#if QT_VERSION >= QT_VERSION_CHECK(5, 0, 0)
+    int delta = event->angleDelta().y();
+#else
+    int delta = (event->orientation() == Qt::Vertical) ? event->delta() : 0;
+#endif
+    if ((_scrollScale > 1) && (delta != 0))
+    {
+        qint64 lines = -(qint64)delta * QApplication::wheelScrollLines() / 120;
+        setTopLine(_bPosFirst / _bytesPerLine + lines);
+        event->accept();
+    }
+    else
+        QAbstractScrollArea::wheelEvent(event);
+}
+
 void QHexEdit::resizeEvent(QResizeEvent *)
 {
     if (_dynamicBytesPerLine)
@@ -976,8 +1351,11 @@ bool QHexEdit::focusNextPrevChild(bool next)
 // ********************************************************************** Handle selections
 void QHexEdit::resetSelection()
 {
+    qint64 oldBegin = _bSelectionBegin;
+    qint64 oldEnd = _bSelectionEnd;
     _bSelectionBegin = _bSelectionInit;
     _bSelectionEnd = _bSelectionInit;
+    updateSelection(oldBegin, oldEnd);
 }
 
 void QHexEdit::resetSelection(qint64 pos)
@@ -988,9 +1366,12 @@ void QHexEdit::resetSelection(qint64 pos)
     if (pos > _chunks->size())
         pos = _chunks->size();
 
+    qint64 oldBegin = _bSelectionBegin;
+    qint64 oldEnd = _bSelectionEnd;
     _bSelectionInit = pos;
     _bSelectionBegin = pos;
     _bSelectionEnd = pos;
+    updateSelection(oldBegin, oldEnd);
 }
 
 void QHexEdit::setSelection(qint64 pos)
@@ -1001,6 +1382,8 @@ void QHexEdit::setSelection(qint64 pos)
     if (pos > _chunks->size())
         pos = _chunks->size();
 
+    qint64 oldBegin = _bSelectionBegin;
+    qint64 oldEnd = _bSelectionEnd;
     if (pos >= _bSelectionInit)
     {
         _bSelectionEnd = pos;
@@ -1011,14 +1394,15 @@ void QHexEdit::setSelection(qint64 pos)
         _bSelectionBegin = pos;
         _bSelectionEnd = _bSelectionInit;
     }
+    updateSelection(oldBegin, oldEnd);
 }
 
-int QHexEdit::getSelectionBegin()
+qint64 QHexEdit::getSelectionBegin()
 {
     return _bSelectionBegin;
 }
 
-int QHexEdit::getSelectionEnd()
+qint64 QHexEdit::getSelectionEnd()
 {
     return _bSelectionEnd;
 }
@@ -1027,16 +1411,19 @@ int QHexEdit::getSelectionEnd()
 void QHexEdit::init()
 {
     _undoStack->clear();
+    _matches.clear();
+    _dataShownValid = false;
     setAddressOffset(0);
     resetSelection(0);
     setCursorPosition(0);
-    verticalScrollBar()->setValue(0);
+    setTopLine(0);
     _modified = false;
 }
 
 void QHexEdit::adjust()
 {
-    // recalc Graphics
+    // recalc Graphics, a wider address area moves everything
+    int pxPosHexX = _pxPosHexX;
     if (_addressArea)
     {
         _addrDigits = addressWidth();
@@ -1046,6 +1433,8 @@ void QHexEdit::adjust()
         _pxPosHexX = _pxGapAdrHex;
     _pxPosAdrX = _pxGapAdr;
     _pxPosAsciiX = _pxPosHexX + _hexCharsInLine * _pxCharWidth + _pxGapHexAscii;
+    if (_pxPosHexX != pxPosHexX)
+        viewport()->update();
 
     // set horizontalScrollBar()
     int pxWidth = _pxPosAsciiX;
@@ -1054,38 +1443,317 @@ void QHexEdit::adjust()
     horizontalScrollBar()->setRange(0, pxWidth - viewport()->width());
     horizontalScrollBar()->setPageStep(viewport()->width());
 
-    // set verticalScrollbar()
+    // set verticalScrollbar(), too many lines for an int are scaled down
     _rowsShown = ((viewport()->height()-4)/_pxCharHeight);
-    int lineCount = (int)(_chunks->size() / (qint64)_bytesPerLine) + 1;
-    verticalScrollBar()->setRange(0, lineCount - _rowsShown);
-    verticalScrollBar()->setPageStep(_rowsShown);
+    qint64 lineCount = _chunks->size() / _bytesPerLine + 1;
+    _topLineMax = qMax<qint64>(lineCount - _rowsShown, 0);
+    _scrollScale = qMax<qint64>((_topLineMax + SCROLL_RANGE - 1) / SCROLL_RANGE, 1);
+    verticalScrollBar()->blockSignals(true);
+    verticalScrollBar()->setRange(0, (int)((_topLineMax + _scrollScale - 1) / _scrollScale));
+    verticalScrollBar()->setPageStep((int)qMax<qint64>(_rowsShown / _scrollScale, 1));
+    verticalScrollBar()->blockSignals(false);
+    setTopLine(_bPosFirst / _bytesPerLine);
+}
+
+void QHexEdit::setTopLine(qint64 line)
+{
+    // _bPosFirst leads, the scroll bar only follows. So lines are moved exactly,
+    // even when one step of the scroll bar covers many of them.
+    line = qBound<qint64>(0, line, _topLineMax);
+    verticalScrollBar()->blockSignals(true);
+    if (line >= _topLineMax)
+        verticalScrollBar()->setValue(verticalScrollBar()->maximum());
+    else
+        verticalScrollBar()->setValue((int)(line / _scrollScale));
+    verticalScrollBar()->blockSignals(false);
 
-    int value = verticalScrollBar()->value();
-    _bPosFirst = (qint64)value * _bytesPerLine;
-    _bPosLast = _bPosFirst + (qint64)(_rowsShown * _bytesPerLine) - 1;
+    _bPosFirst = line * _bytesPerLine;
+    _bPosLast = _bPosFirst + (qint64)_rowsShown * _bytesPerLine - 1;
     if (_bPosLast >= _chunks->size())
         _bPosLast = _chunks->size() - 1;
     readBuffers();
     setCursorPosition(_cursorPosition);
 }
 
+void QHexEdit::scrollAction(int action)
+{
+    // Steps and pages move lines, not scaled scroll bar units
+    qint64 line = _bPosFirst / _bytesPerLine;
+    switch (action)
+    {
+        case QAbstractSlider::SliderSingleStepAdd:
+            line += 1;
+            break;
+        case QAbstractSlider::SliderSingleStepSub:
+            line -= 1;
+            break;
+        case QAbstractSlider::SliderPageStepAdd:
+            line += _rowsShown;
+            break;
+        case QAbstractSlider::SliderPageStepSub:
+            line -= _rowsShown;
+            break;
+        default:
+            return;
+    }
+    setTopLine(line);
+}
+
+void QHexEdit::scrollHorizontal(int)
+{
+    adjust();
+    viewport()->update();
+}
+
+void QHexEdit::scrollVertical(int value)
+{
+    // The slider was dragged or set from outside
+    setTopLine(qMin((qint64)value * _scrollScale, _topLineMax));
+}
+
 void QHexEdit::dataChangedPrivate(int)
 {
-    _modified = _undoStack->index() != 0;
+    if (_editDepth > 0)
+    {
+        _editDataChanged = true;
+        return;
+    }
+    _modified = (_undoStack->index() != 0) || _undoStack->trimmed();
+    _matches.clear();                           // positions are outdated
+    _dataShownValid = false;
     adjust();
+    if (_contentsChange.pos >= 0)
+    {
+        ContentsChange change = _contentsChange;
+        _contentsChange = ContentsChange();
+        emit contentsChanged(change.pos, change.removed, change.added);
+    }
     emit dataChanged();
 }
 
+void QHexEdit::contentsChangedPrivate(qint64 pos, qint64 removed, qint64 added)
+{
+    // Emitted by dataChangedPrivate(), which follows every undo step and transaction
+    _contentsChange.merge(pos, removed, added);
+}
+
 void QHexEdit::refresh()
 {
+    if (_editDepth > 0)
+    {
+        _editRefresh = true;
+        return;
+    }
     ensureVisible();
     readBuffers();
 }
 
 void QHexEdit::readBuffers()
 {
-    _dataShown = _chunks->data(_bPosFirst, _bPosLast - _bPosFirst + _bytesPerLine + 1, &_markedShown);
+    qint64 bPosShown = _bPosShown;
+    QByteArray dataShown = _dataShown;
+    QByteArray markedShown = _markedShown;
+    QByteArray matchesShown = _matchesShown;
+    QByteArray pendingShown = _pendingShown;
+    bool scrolled = _dataShownValid && (_bPosFirst != bPosShown);
+    bool loading = _asyncLoading && _dataShownValid && (_bPosLoaded >= 0);
+
+    // Bytes already shown are kept, as long as the data has not changed. So
+    // scrolling by a line reads just this line.
+    qint64 size = _bPosLast - _bPosFirst + _bytesPerLine + 1;
+    qint64 keepBegin = qMax(bPosShown, _bPosFirst);
+    qint64 keepEnd = qMin(bPosShown + dataShown.size(), _bPosFirst + size);
+    if (loading)
+    {
+        // The view is taken out of the loaded range, missing bytes are placeholders
+        qint64 end = qMin(_bPosFirst + size, _chunks->size());
+        int shown = (int)qMax<qint64>(end - _bPosFirst, 0);
+        _dataShown.fill(0, shown);
+        _markedShown.fill(0, shown);
+        _pendingShown.fill(1, shown);
+        keepBegin = qMax(_bPosLoaded, _bPosFirst);
+        keepEnd = qMin(_bPosLoaded + _dataLoaded.size(), end);
+        if (keepBegin < keepEnd)
+        {
+            int offset = (int)(keepBegin - _bPosFirst);
+            int loaded = (int)(keepBegin - _bPosLoaded);
+            int count = (int)(keepEnd - keepBegin);
+            memcpy(_dataShown.data() + offset, _dataLoaded.constData() + loaded, count);
+            memcpy(_markedShown.data() + offset, _markedLoaded.constData() + loaded, count);
+            memset(_pendingShown.data() + offset, 0, count);
+        }
+        if (scrolled)
+            _prefetch.moved(bPosShown, _bPosFirst, !memchr(_pendingShown.constData(), 1, _pendingShown.size()));
+        loadView(size);
+    }
+    else if (_dataShownValid && (keepBegin < keepEnd))
+    {
+        QByteArray marked;
+        _dataShown.clear();
+        _markedShown.clear();
+        if (keepBegin > _bPosFirst)
+            _dataShown = _chunks->data(_bPosFirst, keepBegin - _bPosFirst, &_markedShown);
+        _dataShown += dataShown.mid((int)(keepBegin - bPosShown), (int)(keepEnd - keepBegin));
+        _markedShown += markedShown.mid((int)(keepBegin - bPosShown), (int)(keepEnd - keepBegin));
+        if (keepEnd < (_bPosFirst + size))
+        {
+            _dataShown += _chunks->data(keepEnd, _bPosFirst + size - keepEnd, &marked);
+            _markedShown += marked;
+        }
+    }
+    else
+        _dataShown = _chunks->data(_bPosFirst, size, &_markedShown);
+    if (!loading)
+        _pendingShown.fill(0, _dataShown.size());
+
+    // After changes the view is read at once. Files go on in the loader from there.
+    if (_asyncLoading && !_dataShownValid)
+    {
+        _loader->cancel();
+        _bPosLoaded = -1;
+        _dataLoaded.clear();
+        _markedLoaded.clear();
+        if (!_chunks->snapshot(_bPosFirst, 0).fileName.isEmpty())
+        {
+            _bPosLoaded = _bPosFirst;
+            _dataLoaded = _dataShown;
+            _markedLoaded = _markedShown;
+            _prefetch.setRequested(_bPosFirst, _bPosFirst + _dataShown.size());
+            loadView(size);                     // the screens around the view
+        }
+    }
     _hexDataShown = QByteArray(_dataShown.toHex());
+    _bPosShown = _bPosFirst;
+    _dataShownValid = true;
+
+    // Only the occurences reaching into the view are decoded
+    _matchesShown.fill(0, _dataShown.size());
+    if (_matches.count() > 0)
+    {
+        QVector<qint64> found = _matches.range(_bPosFirst - _matchSize + 1, _bPosFirst + _dataShown.size());
+        char *shown = _matchesShown.data();
+        int markEnd = 0;
+        for (int idx=0; idx < found.size(); idx++)
+        {
+            int start = (int)(found.at(idx) - _bPosFirst);
+            int end = qMin(start + _matchSize, _dataShown.size());
+            for (int pos=qMax(start, markEnd); pos < end; pos++)
+                shown[pos] = 1;
+            markEnd = qMax(markEnd, end);
+        }
+    }
+
+    // Retained rows are moved, only the uncovered ones are painted. Without a
+    // move only rows, which show other bytes or marks, are painted again.
+    qint64 lines = (_bPosFirst - bPosShown) / _bytesPerLine;
+    if (scrolled && ((lines * _bytesPerLine) == (_bPosFirst - bPosShown)) && (qAbs(lines) < _rowsShown))
+    {
+        int pxDeltaY = -(int)lines * _pxCharHeight;
+        viewport()->update(_cursorRect.translated(0, pxDeltaY));
+        viewport()->scroll(0, pxDeltaY);
+    }
+    else if (_bPosFirst != bPosShown)
+        viewport()->update();
+    else
+    {
+        int rowDirty = -1;
+        for (int row=0; row <= _rowsShown + 1; row++)
+        {
+            int begin = row * _bytesPerLine;
+            bool dirty = rowDiffers(dataShown, _dataShown, begin, _bytesPerLine)
+                    || rowDiffers(markedShown, _markedShown, begin, _bytesPerLine)
+                    || rowDiffers(matchesShown, _matchesShown, begin, _bytesPerLine)
+                    || rowDiffers(pendingShown, _pendingShown, begin, _bytesPerLine);
+
+            // The row behind the data shows an address too
+            if ((dataShown.size() != _dataShown.size())
+                    && (row >= (qMin(dataShown.size(), _dataShown.size()) / _bytesPerLine)))
+                dirty = true;
+            if (dirty && (rowDirty < 0))
+                rowDirty = row;
+            if (!dirty && (rowDirty >= 0))
+            {
+                updateRows(rowDirty, row - 1);
+                rowDirty = -1;
+            }
+        }
+        if (rowDirty >= 0)
+            updateRows(rowDirty, _rowsShown + 1);
+    }
+}
+
+void QHexEdit::loadView(qint64 size)
+{
+    qint64 begin, end;
+    if (!_prefetch.request(_bPosFirst, size, _bytesPerLine, _chunks->size(), begin, end))
+        return;
+
+    // Bytes, which are loaded already, are not read again
+    qint64 loadedEnd = _bPosLoaded + _dataLoaded.size();
+    if ((_bPosLoaded >= 0) && (begin >= _bPosLoaded) && (begin < loadedEnd))
+        begin = loadedEnd;
+    else if ((_bPosLoaded >= 0) && (end > _bPosLoaded) && (end <= loadedEnd))
+        end = _bPosLoaded;
+    if (begin < end)
+        _loader->load(_chunks->snapshot(begin, end - begin), begin, end - begin);
+}
+
+void QHexEdit::selectFound(qint64 pos, int size, bool backward)
+{
+    qint64 curPos = pos*2;
+    if (backward)
+        setCursorPosition(curPos - 1);
+    else
+        setCursorPosition(curPos + size*2);
+    resetSelection(curPos);
+    setSelection(curPos + size*2);
+    ensureVisible();
+}
+
+QHexEditSearch *QHexEdit::startSearch(const QByteArray &ba, qint64 from, bool backward)
+{
+    QHexEditSearch *search = new QHexEditSearch(ba, backward, this);
+    connect(search, SIGNAL(found(qint64)), this, SLOT(searchFound(qint64)));
+    ChunksSnapshot snapshot = _chunks->snapshot();
+    if (snapshot.valid)
+        search->start(snapshot, from);
+    else
+    {
+        // Only Chunks can read this device, so it is searched right now
+        if (backward)
+            search->finish(_chunks->lastIndexOf(ba, from));
+        else
+            search->finish(_chunks->indexOf(ba, from));
+    }
+    return search;
+}
+
+void QHexEdit::searchFound(qint64 pos)
+{
+    QHexEditSearch *search = qobject_cast<QHexEditSearch *>(sender());
+    if (search)
+        selectFound(pos, search->pattern().size(), search->backward());
+}
+
+void QHexEdit::updateBytes(qint64 begin, qint64 end)
+{
+    begin = qMax(begin, _bPosFirst);
+    end = qMin(end, _bPosFirst + (qint64)(_rowsShown + 1) * _bytesPerLine);
+    if (begin < end)
+        updateRows((int)((begin - _bPosFirst) / _bytesPerLine), (int)((end - 1 - _bPosFirst) / _bytesPerLine));
+}
+
+void QHexEdit::updateRows(int first, int last)
+{
+    // Descents and selections reach into the next row
+    viewport()->update(QRect(0, first * _pxCharHeight, viewport()->width(), (last - first + 2) * _pxCharHeight));
+}
+
+void QHexEdit::updateSelection(qint64 oldBegin, qint64 oldEnd)
+{
+    // Only bytes, which enter or leave the selection, are painted again
+    updateBytes(qMin(oldBegin, _bSelectionBegin), qMax(oldBegin, _bSelectionBegin));
+    updateBytes(qMin(oldEnd, _bSelectionEnd), qMax(oldEnd, _bSelectionEnd));
 }
 
 QString QHexEdit::toReadable(const QByteArray &ba)
@@ -1113,6 +1781,49 @@ QString QHexEdit::toReadable(const QByteArray &ba)
     return result;
 }
 
+bool QHexEdit::fitsByteArray(qint64 size)
+{
+    if (size <= UNDO_RANGE_MAX)
+        return true;
+    QApplication::beep();
+    emit editTooLarge(size);
+    return false;
+}
+
+void QHexEdit::viewLoaded(qint64 pos, const QByteArray &data, const QByteArray &highlighted)
+{
+    if (!_asyncLoading || !_dataShownValid)
+        return;
+    if (data.isEmpty())
+        _dataShownValid = false;                // the loader failed, read at once
+    else if ((_bPosLoaded >= 0) && (pos <= (_bPosLoaded + _dataLoaded.size()))
+             && ((pos + data.size()) >= _bPosLoaded))
+    {
+        // Prefetched bytes join the loaded ones, the far ones are dropped
+        QByteArray dataLoaded = _dataLoaded.left((int)qMax<qint64>(pos - _bPosLoaded, 0)) + data;
+        QByteArray markedLoaded = _markedLoaded.left((int)qMax<qint64>(pos - _bPosLoaded, 0)) + highlighted;
+        qint64 end = pos + data.size();
+        if ((_bPosLoaded + _dataLoaded.size()) > end)
+        {
+            dataLoaded += _dataLoaded.mid((int)(end - _bPosLoaded));
+            markedLoaded += _markedLoaded.mid((int)(end - _bPosLoaded));
+        }
+        _bPosLoaded = qMin(_bPosLoaded, pos);
+        qint64 keepBegin = qMax(_bPosLoaded, _bPosFirst - _prefetch.budget());
+        qint64 keepEnd = qMin(_bPosLoaded + dataLoaded.size(), _bPosLast + _bytesPerLine + 1 + _prefetch.budget());
+        _dataLoaded = dataLoaded.mid((int)(keepBegin - _bPosLoaded), (int)(keepEnd - keepBegin));
+        _markedLoaded = markedLoaded.mid((int)(keepBegin - _bPosLoaded), (int)(keepEnd - keepBegin));
+        _bPosLoaded = keepBegin;
+    }
+    else
+    {
+        _bPosLoaded = pos;
+        _dataLoaded = data;
+        _markedLoaded = highlighted;
+    }
+    readBuffers();
+}
+
 void QHexEdit::updateCursor()
 {
     if (_blink)
@@ -1121,3 +1832,113 @@ void QHexEdit::updateCursor()
         _blink = true;
     viewport()->update(_cursorRect);
 }
+
+
+// ********************************************************************** QHexEditSearch
+
+/*! \cond docNever */
+class SearchRunner: public QRunnable
+{
+public:
+    SearchRunner(QHexEditSearch *search)
+    {
+        _search = search;
+    }
+
+    void run()
+    {
+        _search->run();
+    }
+
+private:
+    QHexEditSearch *_search;
+};
+/*! \endcond docNever */
+
+QHexEditSearch::QHexEditSearch(const QByteArray &ba, bool backward, QObject *parent)
+    : QObject(parent)
+{
+    _pattern = ba;
+    _backward = backward;
+    _canceled = false;
+    _finished = false;
+    _from = 0;
+    _result = -1;
+    _search = 0;
+    _progressTimer.setInterval(100);
+    connect(&_progressTimer, SIGNAL(timeout()), this, SLOT(updateProgress()));
+}
+
+QHexEditSearch::~QHexEditSearch()
+{
+    // The runner uses this object, so it has to be over before we are gone
+    if (_search && !_finished)
+    {
+        _search->cancel();
+        _runnerDone.acquire();
+    }
+    delete _search;
+}
+
+QByteArray QHexEditSearch::pattern()
+{
+    return _pattern;
+}
+
+bool QHexEditSearch::backward()
+{
+    return _backward;
+}
+
+void QHexEditSearch::cancel()
+{
+    _canceled = true;
+    if (_search)
+        _search->cancel();
+}
+
+void QHexEditSearch::start(const ChunksSnapshot &snapshot, qint64 from)
+{
+    _from = from;
+    _search = new ParallelSearch(snapshot, _pattern);
+    _progressTimer.start();
+    QThreadPool::globalInstance()->start(new SearchRunner(this));
+}
+
+void QHexEditSearch::finish(qint64 result)
+{
+    // The caller has to connect the signals first
+    _result = result;
+    QTimer::singleShot(0, this, SLOT(searchFinished()));
+}
+
+void QHexEditSearch::run()
+{
+    if (_backward)
+        _result = _search->lastIndexOf(_from);
+    else
+        _result = _search->indexOf(_from);
+    QMetaObject::invokeMethod(this, "searchFinished", Qt::QueuedConnection);
+    _runnerDone.release();
+}
+
+void QHexEditSearch::updateProgress()
+{
+    if (_search)
+        emit progress(_search->scanned(), _search->total());
+}
+
+void QHexEditSearch::searchFinished()
+{
+    _progressTimer.stop();
+    if (_search)
+    {
+        _runnerDone.acquire();
+        emit progress(_search->scanned(), _search->total());
+    }
+    _finished = true;
+    if ((_result >= 0) && !_canceled)
+        emit found(_result);
+    emit finished();
+    deleteLater();
+}
@@ -4,9 +4,13 @@
 #include <QAbstractScrollArea>
 #include <QPen>
 #include <QBrush>
+#include <QSemaphore>
+#include <QTimer>
 
 #include "chunks.h"
 #include "commands.h"
+#include "glyphatlas.h"
+#include "viewloader.h"
 
 #ifdef QHEXEDIT_EXPORTS
 #define QHEXEDIT_API Q_DECL_EXPORT
@@ -16,6 +20,9 @@
 #define QHEXEDIT_API
 #endif
 
+class ParallelSearch;
+class QHexEditSearch;
+
 /** \mainpage
 QHexEdit is a binary editor widget for Qt.
 
@@ -49,7 +56,9 @@ QHexEdit comes with undo/redo functionality. All changes can be undone, by
 pressing the undo-key (usually ctr-z). They can also be redone afterwards.
 The undo/redo framework is cleared, when setData() sets up a new
 content for the editor. You can search data inside the content with indexOf()
-and lastIndexOf(). The replace() function is to change located subdata. This
+and lastIndexOf(), on big data startIndexOf() and startLastIndexOf() search
+without blocking the GUI. findAll() marks all occurences, nextMatch() and
+previousMatch() step through them. The replace() function is to change located subdata. This
 'replaced' data can also be undone by the undo/redo framework.
 
 QHexEdit is based on QIODevice, that's why QHexEdit can handle big amounts of
@@ -120,6 +129,11 @@ class QHEXEDIT_API QHexEdit : public QAbstractScrollArea
     */
     Q_PROPERTY(QColor highlightingColor READ highlightingColor WRITE setHighlightingColor)
 
+    /*! Property match color sets (setMatchColor()) the background color of the
+    occurences found by findAll(). You can also read the color (matchColor()).
+    */
+    Q_PROPERTY(QColor matchColor READ matchColor WRITE setMatchColor)
+
     /*! Porperty overwrite mode sets (setOverwriteMode()) or gets (overwriteMode()) the mode
     in which the editor works. In overwrite mode the user will overwrite existing data. The
     size of data will be constant. In insert mode the size will grow, when inserting
@@ -163,10 +177,153 @@ public:
     QByteArray dataAt(qint64 pos, qint64 count=-1);
 
     /*! Givs back the data into a \param iODevice starting at position \param pos
-    and delivering \param count bytes.
+    and delivering \param count bytes. The data is streamed, unchanged parts are
+    copied in big blocks out of the source.
     */
     bool write(QIODevice &iODevice, qint64 pos=0, qint64 count=-1);
 
+    /*! Writes only the changed parts into \param iODevice, which has to hold the data
+    as it was read by setData(), usually the file itself. This works, if bytes were
+    overwritten only. When bytes were inserted or removed, nothing is written and false
+    is returned, then the data has to be saved with write().
+    */
+    bool writeChanges(QIODevice &iODevice);
+
+    /*! Switches memory mapped access on or off. When the data is a QFile, the file
+    is mapped and stays open, unmodified data is copied straight out of the mapping.
+    Other devices and files, which can not be mapped, are read as usual. The size of
+    the file is checked before every read, but a program, which truncates the file
+    while it is read, still makes the system kill QHexEdit (SIGBUS on Unix). So map
+    files only, which no other program shortens meanwhile.
+    \return true, if the data is mapped now
+    */
+    bool setMemoryMapped(bool memoryMapped);
+
+    /*! Returns true, if the data is accessed via a memory mapping. */
+    bool memoryMapped();
+
+    /*! Keeps the QIODevice open between two accesses. This avoids a lot of open
+    and close calls on slow devices (e.g. network mounts), but other programs can
+    not rewrite the file while QHexEdit shows it. Default is false.
+    */
+    void setKeepOpen(bool keepOpen);
+
+    /*! Returns true, if the QIODevice is kept open. */
+    bool keepOpen();
+
+    /*! Sets up a cache for unmodified data. The QIODevice is read in aligned
+    blocks of \param blockSize bytes and up to \param cacheSize bytes of them are
+    kept in a LRU cache. A \param cacheSize of 0 switches the cache off (default).
+    Changes of the file by other programs are not seen, while it is cached.
+    */
+    void setCacheSize(qint64 cacheSize, int blockSize=0x10000);
+
+    /*! Returns the size of the cache in bytes. */
+    qint64 cacheSize();
+
+    /*! Returns the number of block reads, which were served by the cache. */
+    qint64 cacheHits();
+
+    /*! Returns the number of block reads, which had to access the QIODevice. */
+    qint64 cacheMisses();
+
+    /*! Sets the memory for modified data. Beyond \param memoryBudget bytes, the least
+    recently used modified chunks are written to a temporary file in a thread and are
+    read back, when they are accessed. A \param memoryBudget of 0 keeps all modified
+    data in memory (default).
+    */
+    void setMemoryBudget(qint64 memoryBudget);
+
+    /*! Returns the memory budget for modified data in bytes. */
+    qint64 memoryBudget();
+
+    /*! Returns the number of modified bytes in memory. */
+    qint64 residentSize();
+
+    /*! Returns the number of modified bytes in the temporary file. */
+    qint64 spilledSize();
+
+    /*! Sets the memory for the undo/redo history. Beyond \param memoryBudget bytes, the
+    older steps are compressed in a thread. If this is not enough, the oldest steps are
+    dropped, they can not be undone any more and isModified() stays true. The newest step
+    is not compressed, so an edit bigger than the budget can not be undone at all. A
+    \param memoryBudget of 0
+    keeps all steps as they are (default).
+    */
+    void setUndoMemoryBudget(qint64 memoryBudget);
+
+    /*! Returns the memory budget for the undo/redo history in bytes. */
+    qint64 undoMemoryBudget();
+
+    /*! Returns the bytes, which are used by the undo/redo history. */
+    qint64 undoMemoryUsage();
+
+    /*! Switches the undo journal on or off. With \param undoJournal, the bytes of big
+    edits are written to a temporary file for undo/redo and are read back, when they are
+    undone or redone. Only small edits stay in memory. Default is off.
+    */
+    void setUndoJournal(bool undoJournal);
+
+    /*! Returns true, if the undo journal is switched on. */
+    bool undoJournal();
+
+    /*! Switches the parallel search of indexOf() and lastIndexOf() on or off. The data
+    is split into segments, which are searched by the threads of the global QThreadPool.
+    A snapshot of the data is searched, the source has to be a file or a QByteArray.
+    Other devices are searched in one thread as usual.
+    */
+    void setParallelSearch(bool parallelSearch);
+
+    /*! Returns true, if indexOf() and lastIndexOf() search with several threads. */
+    bool parallelSearch();
+
+    /*! Switches the loading of the bytes in view by a thread on or off (default off).
+    Files are read around the view in the background, so scrolling through a file on a
+    slow device does not block the GUI. Bytes, which are not loaded yet, are painted
+    as placeholders. After changes of the data the view is read at once as usual, other
+    devices are always read at once.
+    */
+    void setAsyncLoading(bool asyncLoading);
+
+    /*! Returns true, if the bytes in view are loaded by a thread. */
+    bool asyncLoading();
+
+    /*! Sets the number of screens, which are loaded ahead of the view, when
+    asyncLoading() is on (default 4). Ahead is the direction the view moved last, a
+    quarter of it is loaded behind the view. After a move bigger than a screen, e.g. by
+    the scroll bar, the screens are as big as this move. So paging through a file finds the next pages
+    loaded already. The next range is requested, before two more moves like the last
+    one would run out of bytes. Without asyncLoading() the view is read at once and
+    nothing is loaded ahead, as this would block the GUI, which the loader spares.
+    */
+    void setPrefetchScreens(int prefetchScreens);
+
+    /*! Returns the number of screens, which are loaded ahead of the view. */
+    int prefetchScreens();
+
+    /*! Sets the most bytes, which are loaded beyond the view (default 256 KiB). It
+    caps the screens of setPrefetchScreens(), ahead and behind the view alike.
+    */
+    void setPrefetchSize(qint64 prefetchSize);
+
+    /*! Returns the most bytes, which are loaded beyond the view. */
+    qint64 prefetchSize();
+
+    /*! Returns the number of moves of the view, which found all bytes loaded. */
+    qint64 prefetchHits();
+
+    /*! Returns the number of moves of the view, which showed placeholders. */
+    qint64 prefetchMisses();
+
+    /*! Switches painting out of a glyph atlas on or off (default on). The hex pairs
+    and ascii chars are rendered once per text color into a pixmap and copied from
+    there, instead of laying out the text of every byte on each paint event.
+    */
+    void setGlyphAtlas(bool glyphAtlas);
+
+    /*! Returns true, if the bytes are painted out of a glyph atlas. */
+    bool glyphAtlas();
+
 
     // Char handling
 
@@ -180,6 +337,8 @@ public:
     /*! Removes len bytes from the content.
     \param pos Index position, where to remove
     \param len Amount of bytes to remove
+    More than about 2 GiB can not be kept for undo, then nothing is removed and
+    editTooLarge() is emitted.
     */
     void remove(qint64 pos, qint64 len=1);
 
@@ -204,10 +363,36 @@ public:
     \param pos Index position, where to overwrite
     \param ba QByteArray, which is inserted
     \param len count of bytes to overwrite
-    The data is overwritten and size of data may change.
+    The data is overwritten and size of data may change. Like remove(), len is
+    limited to about 2 GiB.
     */
     void replace(qint64 pos, qint64 len, const QByteArray &ba);
 
+    /*! Replaces all occurences of a byte array in one step, which is undone as a whole.
+    Only occurences, which lie completely inside of from .. to - 1, are replaced.
+    \param ba QByteArray, which is to replace
+    \param replacement QByteArray, which is inserted instead
+    \param from first byte position of the range, default is the begin of the data
+    \param to byte position behind the range, -1 (default) is the end of the data
+    \return Number of replaced occurences
+    */
+    qint64 replaceAll(const QByteArray &ba, const QByteArray &replacement, qint64 from=0, qint64 to=-1);
+
+
+    // Edit transactions
+
+    /*! Starts a transaction of edits. Until the outermost transaction is ended with
+    endEdit(), edits neither recalc nor read the view and dataChanged() is not emitted.
+    So many edits in a row, e.g. in a loop of insert() calls, cost one refresh.
+    Transactions may be nested.
+    */
+    void beginEdit();
+
+    /*! Ends a transaction of edits. When the outermost transaction ends, the view is
+    brought up to date and dataChanged() is emitted once, if the data has changed.
+    */
+    void endEdit();
+
 
     // Utility functioins
     /*! Calc cursor position from graphics position
@@ -239,6 +424,51 @@ public:
      */
     qint64 lastIndexOf(const QByteArray &ba, qint64 from);
 
+    /*! Find all occurences of ba in QHexEdit data and mark them. The occurences
+     * are kept until the data changes or clearMatches() is called. With
+     * setParallelSearch() the data is searched with several threads.
+     * \param ba Data to find
+     * \return Number of occurences
+     */
+    qint64 findAll(const QByteArray &ba);
+
+    /*! Removes the marks of findAll() */
+    void clearMatches();
+
+    /*! Returns the number of occurences found by findAll() */
+    qint64 matchCount();
+
+    /*! Selects the first occurence of findAll() at or behind from
+     * \param from Point where the search starts
+     * \return pos if fond, else -1
+     */
+    qint64 nextMatch(qint64 from);
+
+    /*! Selects the last occurence of findAll(), which ends in front of from,
+     * like lastIndexOf() does
+     * \param from Point where the search starts
+     * \return pos if fond, else -1
+     */
+    qint64 previousMatch(qint64 from);
+
+    /*! Starts to find the first occurence of ba in QHexEdit data in other threads
+     * and returns at once. A snapshot of the data is searched, so the data may be
+     * edited meanwhile. When the search is successful, the occurence is selected
+     * like indexOf() does.
+     * \param ba Data to find
+     * \param from Point where the search starts
+     * \return Handle, which reports the progress and the result of the search
+     */
+    QHexEditSearch *startIndexOf(const QByteArray &ba, qint64 from);
+
+    /*! Starts to find the last occurence of ba in QHexEdit data in other threads,
+     * see startIndexOf().
+     * \param ba Data to find
+     * \param from Point where the search starts
+     * \return Handle, which reports the progress and the result of the search
+     */
+    QHexEditSearch *startLastIndexOf(const QByteArray &ba, qint64 from);
+
     /*! Gives back a formatted image of the selected content of QHexEdit
     */
     QString selectionToReadableString();
@@ -275,9 +505,24 @@ signals:
     /*! The signal is emitted every time, the data is changed. */
     void dataChanged();
 
+    /*! The signal is emitted before dataChanged(), it tells which bytes changed: the
+    \param removed bytes at \param pos were replaced by \param added bytes. Edits,
+    undo and redo are described alike, all edits of a transaction (see beginEdit())
+    or of an undo step as one range. So caches of the data only have to drop this
+    range instead of reading all data again.
+    */
+    void contentsChanged(qint64 pos, qint64 removed, qint64 added);
+
     /*! The signal is emitted every time, the overwrite mode is changed. */
     void overwriteModeChanged(bool state);
 
+    /*! The signal is emitted, when a cut, copy, remove or replace is refused,
+    because its \param size bytes do not fit into a QByteArray (about 2 GiB). For cut
+    and copy, this is the size of the hex text for the clipboard. Nothing is changed
+    then and QApplication::beep() is called.
+    */
+    void editTooLarge(qint64 size);
+
 
 /*! \cond docNever */
 public:
@@ -320,6 +565,9 @@ public:
     QColor highlightingColor();
     void setHighlightingColor(const QColor &color);
 
+    QColor matchColor();
+    void setMatchColor(const QColor &color);
+
     bool overwriteMode();
     void setOverwriteMode(bool overwriteMode);
 
@@ -336,25 +584,40 @@ protected:
     void mousePressEvent(QMouseEvent * event);
     void paintEvent(QPaintEvent *event);
     void resizeEvent(QResizeEvent *);
+    void wheelEvent(QWheelEvent *event);
     virtual bool focusNextPrevChild(bool next);
 private:
     // Handle selections
     void resetSelection(qint64 pos);            // set selectionStart and selectionEnd to pos
     void resetSelection();                      // set selectionEnd to selectionStart
     void setSelection(qint64 pos);              // set min (if below init) or max (if greater init)
-    int getSelectionBegin();
-    int getSelectionEnd();
+    qint64 getSelectionBegin();
+    qint64 getSelectionEnd();
 
     // Private utility functions
     void init();
     void readBuffers();
+    void selectFound(qint64 pos, int size, bool backward);
+    void loadView(qint64 size);                 // request the bytes around the view
+    void setTopLine(qint64 line);               // scroll line to the top of the view
+    void updateBytes(qint64 begin, qint64 end); // repaint the rows of bytes begin .. end - 1
+    void updateRows(int first, int last);       // repaint rows first .. last of the view
+    void updateSelection(qint64 oldBegin, qint64 oldEnd); // repaint bytes with changed selection
+    QHexEditSearch *startSearch(const QByteArray &ba, qint64 from, bool backward);
     QString toReadable(const QByteArray &ba);
+    bool fitsByteArray(qint64 size);            // else beep and emit editTooLarge()
 
 private slots:
     void adjust();                              // recalc pixel positions
     void dataChangedPrivate(int idx=0);        // emit dataChanged() signal
+    void contentsChangedPrivate(qint64 pos, qint64 removed, qint64 added); // merge into _contentsChange
     void refresh();                             // ensureVisible() and readBuffers()
+    void scrollAction(int action);              // step exactly through the lines
+    void scrollHorizontal(int value);           // adjust() and repaint all
+    void scrollVertical(int value);             // map scroll bar value to top line
+    void searchFound(qint64 pos);               // select result of QHexEditSearch
     void updateCursor();                        // update blinking cursor
+    void viewLoaded(qint64 pos, const QByteArray &data, const QByteArray &highlighted);
 
 private:
     // Name convention: pixel positions start with _px
@@ -376,6 +639,8 @@ private:
     qint64 _bSelectionInit;                     // memory position of Selection
     qint64 _bPosFirst;                          // position of first byte shown
     qint64 _bPosLast;                           // position of last byte shown
+    qint64 _bPosShown;                          // position of first byte in _dataShown
+    qint64 _bPosLoaded;                         // position of _dataLoaded, -1 if none
     qint64 _bPosCurrent;                        // current position
 
     // variables to store the property values
@@ -392,6 +657,8 @@ private:
     QPen _penSelection;
     QBrush _brushHighlighted;
     QPen _penHighlighted;
+    QBrush _brushMatch;
+    QPen _penMatch;
     bool _readOnly;
     bool _hexCaps;
     bool _dynamicBytesPerLine;
@@ -399,6 +666,7 @@ private:
     // other variables
     bool _editAreaIsAscii;                      // flag about the ascii mode edited
     int _addrDigits;                            // real no of addressdigits, may be > addressWidth
+    GlyphAtlas _atlas;                          // pre-rendered hex pairs and ascii chars
     bool _blink;                                // help get cursor blinking
     QBuffer _bData;                             // buffer, when setup with QByteArray
     Chunks *_chunks;                            // IODevice based access to data
@@ -407,13 +675,94 @@ private:
     QRect _cursorRect;                          // physical dimensions of cursor
     QByteArray _data;                           // QHexEdit's data, when setup with QByteArray
     QByteArray _dataShown;                      // data in the current View
+    bool _dataShownValid;                       // data unchanged since _dataShown was read
+    QByteArray _dataLoaded;                     // data around the view read by _loader
+    QByteArray _markedLoaded;
     QByteArray _hexDataShown;                   // data in view, transformed to hex
     qint64 _lastEventSize;                      // size, which was emitted last time
     QByteArray _markedShown;                    // marked data in view
+    MatchIndex _matches;                        // occurences found by findAll()
+    QByteArray _matchesShown;                   // occurences in view
+    int _matchSize;                             // size of the occurences
     bool _modified;                             // Is any data in editor modified?
+    bool _parallelSearch;                       // search with ParallelSearch
+    bool _asyncLoading;                         // read the view with _loader
+    ViewPrefetch _prefetch;                     // range around the view for _loader
+    ViewLoader *_loader;                        // reads the view in a thread
+    QByteArray _pendingShown;                   // bytes in view, which are still loading
+    bool _glyphAtlas;                           // paint bytes out of _atlas
+    qint64 _scrollScale;                        // lines per step of the vertical scroll bar
+    qint64 _topLineMax;                         // last line, which can be on top
     int _rowsShown;                             // lines of text shown
+    int _editDepth;                             // nested beginEdit() calls
+    bool _editDataChanged;                      // dataChangedPrivate() deferred by a transaction
+    bool _editRefresh;                          // refresh() deferred by a transaction
+    ContentsChange _contentsChange;             // changes since contentsChanged() was emitted
     UndoStack * _undoStack;                     // Stack to store edit actions for undo/redo
     /*! \endcond docNever */
 };
 
+
+/** QHexEditSearch is the handle of a search started by QHexEdit::startIndexOf() or
+QHexEdit::startLastIndexOf(). The search runs on the global QThreadPool, the
+signals are emitted in the thread of QHexEdit. When a file or a QByteArray is
+searched, the data is split into segments, which are searched in parallel. Other
+devices are searched at once, the signals follow as soon as the event loop runs.
+
+After finished() the handle deletes itself, so keep it in a QPointer, if you
+want to cancel the search later on.
+*/
+class QHEXEDIT_API QHexEditSearch : public QObject
+{
+    Q_OBJECT
+
+public:
+    ~QHexEditSearch();
+
+    /*! Returns the data to find. */
+    QByteArray pattern();
+
+    /*! Returns true, if the search goes from back to front. */
+    bool backward();
+
+public slots:
+    /*! Stops the search. finished() is emitted without found(). */
+    void cancel();
+
+signals:
+    /*! Reports the progress of the search a few times per second. */
+    void progress(qint64 scanned, qint64 total);
+
+    /*! The occurence was found at pos, it is already selected in QHexEdit. */
+    void found(qint64 pos);
+
+    /*! The search is over, found() was emitted before, if it was successful. */
+    void finished();
+
+/*! \cond docNever */
+private:
+    friend class QHexEdit;
+    friend class SearchRunner;
+    QHexEditSearch(const QByteArray &ba, bool backward, QObject *parent);
+    void start(const ChunksSnapshot &snapshot, qint64 from);
+    void finish(qint64 result);
+    void run();                                 // runs in a thread of the pool
+
+private slots:
+    void updateProgress();
+    void searchFinished();
+
+private:
+    QByteArray _pattern;
+    bool _backward;
+    bool _canceled;
+    bool _finished;
+    qint64 _from;
+    qint64 _result;
+    ParallelSearch *_search;
+    QSemaphore _runnerDone;                     // released, when run() is over
+    QTimer _progressTimer;
+    /*! \endcond docNever */
+};
+
 #endif // QHEXEDIT_H
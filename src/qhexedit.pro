@@ -11,12 +11,28 @@ DEFINES += QHEXEDIT_EXPORTS
 HEADERS = \
     qhexedit.h \
     chunks.h \
+    chunktree.h \
+    changedbits.h \
+    chunkspill.h \
+    searchengine.h \
+    parallelsearch.h \
+    matchindex.h \
+    viewloader.h \
+    glyphatlas.h \
     commands.h
 
 
 SOURCES = \
     qhexedit.cpp \
     chunks.cpp \
+    chunktree.cpp \
+    changedbits.cpp \
+    chunkspill.cpp \
+    searchengine.cpp \
+    parallelsearch.cpp \
+    matchindex.cpp \
+    viewloader.cpp \
+    glyphatlas.cpp \
     commands.cpp
 
 Release:TARGET = qhexedit
@@ -19,6 +19,14 @@ QTDIR_build:DESTDIR     = $$QT_BUILD_TREE/plugins/designer
 HEADERS = \
     qhexedit.h \
     chunks.h \
+    chunktree.h \
+    changedbits.h \
+    chunkspill.h \
+    searchengine.h \
+    parallelsearch.h \
+    matchindex.h \
+    viewloader.h \
+    glyphatlas.h \
     commands.h \
 	QHexEditPlugin.h
 
@@ -26,6 +34,14 @@ HEADERS = \
 SOURCES = \
     qhexedit.cpp \
     chunks.cpp \
+    chunktree.cpp \
+    changedbits.cpp \
+    chunkspill.cpp \
+    searchengine.cpp \
+    parallelsearch.cpp \
+    matchindex.cpp \
+    viewloader.cpp \
+    glyphatlas.cpp \
     commands.cpp \
 	QHexEditPlugin.cpp
 	
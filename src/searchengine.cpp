@@ -0,0 +1,471 @@
+#include <string.h>
+
+#include "searchengine.h"
+
+#if !defined(SEARCH_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2)))
+#define SEARCH_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(SEARCH_SSE2) && (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define SEARCH_AVX2
+#include <immintrin.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// Without vector instructions, patterns with at least this length are searched with
+// Boyer-Moore-Horspool. The vector filter streams faster through the data than the
+// skip table jumps, even for long patterns, so it is used whenever possible.
+#define HORSPOOL_SIZE 32
+
+
+// ***************************************** Bit scan helpers
+
+static inline int lowestBit(quint32 mask)
+{
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanForward(&idx, mask);
+    return (int)idx;
+#else
+    return __builtin_ctz(mask);
+#endif
+}
+
+static inline int highestBit(quint32 mask)
+{
+#if defined(_MSC_VER)
+    unsigned long idx;
+    _BitScanReverse(&idx, mask);
+    return (int)idx;
+#else
+    return 31 - __builtin_clz(mask);
+#endif
+}
+
+
+// ***************************************** Vectorized first/last byte filter
+
+/* Every function tests the candidates data[i .. i + width - 1] and gives back
+ * the first (forward) or last (backward) complete match or -1. */
+
+#ifdef SEARCH_SSE2
+static qint64 filterSse2(const char *data, qint64 from, qint64 to, const QByteArray &pattern)
+{
+    // Candidates from .. to - 1, to has to leave room for 16 loads behind pattern end
+    const int m = pattern.size();
+    const __m128i first = _mm_set1_epi8(pattern.at(0));
+    const __m128i last = _mm_set1_epi8(pattern.at(m - 1));
+    for (qint64 i = from; i < to; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(data + i + m - 1));
+        quint32 mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask)
+        {
+            int bit = lowestBit(mask);
+            if ((m < 3) || (memcmp(data + i + bit + 1, pattern.constData() + 1, m - 2) == 0))
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return -1;
+}
+
+static qint64 lastFilterSse2(const char *data, qint64 from, qint64 to, const QByteArray &pattern)
+{
+    // Candidates from .. to - 1 are tested in blocks of 16 starting at the end
+    const int m = pattern.size();
+    const __m128i first = _mm_set1_epi8(pattern.at(0));
+    const __m128i last = _mm_set1_epi8(pattern.at(m - 1));
+    for (qint64 i = to - 16; i >= from; i -= 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(data + i + m - 1));
+        quint32 mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+        while (mask)
+        {
+            int bit = highestBit(mask);
+            if ((m < 3) || (memcmp(data + i + bit + 1, pattern.constData() + 1, m - 2) == 0))
+                return i + bit;
+            mask &= ~(1u << bit);
+        }
+    }
+    return -1;
+}
+#endif
+
+#ifdef SEARCH_AVX2
+__attribute__((target("avx2")))
+static qint64 filterAvx2(const char *data, qint64 from, qint64 to, const QByteArray &pattern)
+{
+    const int m = pattern.size();
+    const __m256i first = _mm256_set1_epi8(pattern.at(0));
+    const __m256i last = _mm256_set1_epi8(pattern.at(m - 1));
+    for (qint64 i = from; i < to; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(data + i + m - 1));
+        quint32 mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask)
+        {
+            int bit = lowestBit(mask);
+            if ((m < 3) || (memcmp(data + i + bit + 1, pattern.constData() + 1, m - 2) == 0))
+                return i + bit;
+            mask &= mask - 1;
+        }
+    }
+    return -1;
+}
+
+__attribute__((target("avx2")))
+static qint64 lastFilterAvx2(const char *data, qint64 from, qint64 to, const QByteArray &pattern)
+{
+    const int m = pattern.size();
+    const __m256i first = _mm256_set1_epi8(pattern.at(0));
+    const __m256i last = _mm256_set1_epi8(pattern.at(m - 1));
+    for (qint64 i = to - 32; i >= from; i -= 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(data + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(data + i + m - 1));
+        quint32 mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last)));
+        while (mask)
+        {
+            int bit = highestBit(mask);
+            if ((m < 3) || (memcmp(data + i + bit + 1, pattern.constData() + 1, m - 2) == 0))
+                return i + bit;
+            mask &= ~(1u << bit);
+        }
+    }
+    return -1;
+}
+
+static bool cpuAvx2()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+
+static bool hasAvx2()
+{
+    // The static is initialized once, the compiler guards it against other threads
+    static const bool avx2 = cpuAvx2();
+    return avx2;
+}
+#endif
+
+#ifdef MODUL_TEST
+static bool plainSearch = false;                // set by the test, before it searches
+#endif
+
+
+// ***************************************** Constructor
+
+SearchEngine::SearchEngine(const QByteArray &pattern)
+{
+    _pattern = pattern;
+    const int m = _pattern.size();
+#ifdef SEARCH_SSE2
+    _vector = true;
+#else
+    _vector = false;
+#endif
+#ifdef MODUL_TEST
+    _vector = _vector && !plainSearch;
+#endif
+    _horspool = !_vector && (m >= HORSPOOL_SIZE);
+    if (_horspool)
+    {
+        const uchar *p = (const uchar *)_pattern.constData();
+        for (int c = 0; c < 256; c++)
+        {
+            _skip[c] = m;
+            _skipBack[c] = m;
+        }
+        for (int idx = 0; idx < (m - 1); idx++)
+            _skip[p[idx]] = m - 1 - idx;
+        for (int idx = m - 1; idx > 0; idx--)
+            _skipBack[p[idx]] = idx;
+    }
+}
+
+const QByteArray &SearchEngine::pattern() const
+{
+    return _pattern;
+}
+
+int SearchEngine::size() const
+{
+    return _pattern.size();
+}
+
+
+// ***************************************** Search functions
+
+qint64 SearchEngine::indexIn(const char *data, qint64 size, qint64 from) const
+{
+    if (from < 0)
+        from = 0;
+    if (_pattern.isEmpty() || ((size - from) < _pattern.size()))
+        return -1;
+    if (_horspool)
+        return indexHorspool(data, size, from);
+    return indexFilter(data, size, from);
+}
+
+qint64 SearchEngine::lastIndexIn(const char *data, qint64 size, qint64 from) const
+{
+    if (from > (size - _pattern.size()))
+        from = size - _pattern.size();
+    if (_pattern.isEmpty() || (from < 0))
+        return -1;
+    if (_horspool)
+        return lastIndexHorspool(data, size, from);
+    return lastIndexFilter(data, size, from);
+}
+
+
+qint64 SearchEngine::indexIn(SearchSource &source, qint64 from, qint64 to) const
+{
+    qint64 result = -1;
+    const int overlap = _pattern.size() - 1;
+    QByteArray border;                          // last bytes in front of pos
+    QByteArray buffer;
+    qint64 pos = qMax<qint64>(from, 0);
+
+    if (_pattern.isEmpty())
+        return result;
+
+    while ((result < 0) && (pos < to))
+    {
+        const char *segment;
+        qint64 count = source.readSegment(pos, to - pos, false, segment, buffer);
+        if (count <= 0)
+            break;
+
+        if (!border.isEmpty())
+        {
+            QByteArray joint = border + QByteArray(segment, (int)qMin<qint64>(count, overlap));
+            qint64 idx = indexIn(joint.constData(), joint.size());
+            if ((idx >= 0) && (idx < border.size()))
+                result = pos - border.size() + idx;
+        }
+        if (result < 0)
+        {
+            qint64 idx = indexIn(segment, count);
+            if (idx >= 0)
+                result = pos + idx;
+        }
+
+        if (count >= overlap)
+            border = QByteArray(segment + count - overlap, overlap);
+        else
+            border = (border + QByteArray(segment, (int)count)).right(overlap);
+        pos += count;
+    }
+    return result;
+}
+
+qint64 SearchEngine::lastIndexIn(SearchSource &source, qint64 from, qint64 to) const
+{
+    // Like indexIn(), but the pieces are searched from back to front
+    qint64 result = -1;
+    const int overlap = _pattern.size() - 1;
+    QByteArray border;                          // first bytes behind pos
+    QByteArray buffer;
+    qint64 pos = to;
+    from = qMax<qint64>(from, 0);
+
+    if (_pattern.isEmpty())
+        return result;
+
+    while ((result < 0) && (pos > from))
+    {
+        const char *segment;
+        qint64 count = source.readSegment(pos, pos - from, true, segment, buffer);
+        if (count <= 0)
+            break;
+
+        if (!border.isEmpty())
+        {
+            int head = (int)qMin<qint64>(count, overlap);
+            QByteArray joint = QByteArray(segment + count - head, head) + border;
+            qint64 idx = lastIndexIn(joint.constData(), joint.size(), head - 1);
+            if (idx >= 0)
+                result = pos - head + idx;
+        }
+        if (result < 0)
+        {
+            qint64 idx = lastIndexIn(segment, count, count - 1);
+            if (idx >= 0)
+                result = pos - count + idx;
+        }
+
+        if (count >= overlap)
+            border = QByteArray(segment, overlap);
+        else
+            border = (QByteArray(segment, (int)count) + border).left(overlap);
+        pos -= count;
+    }
+    return result;
+}
+
+void SearchEngine::indexAll(SearchSource &source, qint64 from, qint64 to, MatchIndex &matches, bool overlapping) const
+{
+    // Like indexIn(), but the search goes on behind every match. The border is
+    // shorter than the pattern, so a match starting in it always ends in the
+    // current piece and is found only once.
+    const int overlap = _pattern.size() - 1;
+    const int step = overlapping ? 1 : _pattern.size();
+    QByteArray border;                          // last bytes in front of pos
+    QByteArray buffer;
+    qint64 pos = qMax<qint64>(from, 0);
+    qint64 nextStart = pos;                     // first position a match may start at
+
+    if (_pattern.isEmpty())
+        return;
+
+    while (pos < to)
+    {
+        const char *segment;
+        qint64 count = source.readSegment(pos, to - pos, false, segment, buffer);
+        if (count <= 0)
+            break;
+
+        if (!border.isEmpty())
+        {
+            QByteArray joint = border + QByteArray(segment, (int)qMin<qint64>(count, overlap));
+            qint64 jointPos = pos - border.size();
+            for (qint64 idx = indexIn(joint.constData(), joint.size(), nextStart - jointPos);
+                 (idx >= 0) && (idx < border.size());
+                 idx = indexIn(joint.constData(), joint.size(), idx + step))
+            {
+                matches.append(jointPos + idx);
+                nextStart = jointPos + idx + step;
+            }
+        }
+        for (qint64 idx = indexIn(segment, count, nextStart - pos); idx >= 0; idx = indexIn(segment, count, idx + step))
+        {
+            matches.append(pos + idx);
+            nextStart = pos + idx + step;
+        }
+
+        if (count >= overlap)
+            border = QByteArray(segment + count - overlap, overlap);
+        else
+            border = (border + QByteArray(segment, (int)count)).right(overlap);
+        pos += count;
+    }
+}
+
+
+// ***************************************** Private search implementations
+
+bool SearchEngine::matchAt(const char *data) const
+{
+    return memcmp(data, _pattern.constData(), _pattern.size()) == 0;
+}
+
+qint64 SearchEngine::indexFilter(const char *data, qint64 size, qint64 from) const
+{
+    const int m = _pattern.size();
+    const qint64 end = size - m + 1;            // behind last possible candidate
+    qint64 idx = from;
+
+    // The vector loops read width bytes starting at idx + m - 1
+#ifdef SEARCH_AVX2
+    if (_vector && hasAvx2() && ((end - idx) >= 32))
+    {
+        qint64 to = idx + ((end - idx) & ~(qint64)31);
+        qint64 result = filterAvx2(data, idx, to, _pattern);
+        if (result >= 0)
+            return result;
+        idx = to;
+    }
+#endif
+#ifdef SEARCH_SSE2
+    if (_vector && ((end - idx) >= 16))
+    {
+        qint64 to = idx + ((end - idx) & ~(qint64)15);
+        qint64 result = filterSse2(data, idx, to, _pattern);
+        if (result >= 0)
+            return result;
+        idx = to;
+    }
+#endif
+
+    const char first = _pattern.at(0);
+    const char last = _pattern.at(m - 1);
+    for (; idx < end; idx++)
+        if ((data[idx] == first) && (data[idx + m - 1] == last) && matchAt(data + idx))
+            return idx;
+    return -1;
+}
+
+qint64 SearchEngine::lastIndexFilter(const char *data, qint64 size, qint64 from) const
+{
+    Q_UNUSED(size);
+    const int m = _pattern.size();
+    qint64 end = from + 1;                      // behind last candidate
+
+    // The vector loops work down from end, the scalar loop does the rest in front
+#ifdef SEARCH_AVX2
+    if (_vector && hasAvx2() && (end >= 32))
+    {
+        qint64 start = end & 31;
+        qint64 result = lastFilterAvx2(data, start, end, _pattern);
+        if (result >= 0)
+            return result;
+        end = start;
+    }
+#endif
+#ifdef SEARCH_SSE2
+    if (_vector && (end >= 16))
+    {
+        qint64 start = end & 15;
+        qint64 result = lastFilterSse2(data, start, end, _pattern);
+        if (result >= 0)
+            return result;
+        end = start;
+    }
+#endif
+
+    const char first = _pattern.at(0);
+    const char last = _pattern.at(m - 1);
+    for (qint64 idx = end - 1; idx >= 0; idx--)
+        if ((data[idx] == first) && (data[idx + m - 1] == last) && matchAt(data + idx))
+            return idx;
+    return -1;
+}
+
+qint64 SearchEngine::indexHorspool(const char *data, qint64 size, qint64 from) const
+{
+    const int m = _pattern.size();
+    const uchar *udata = (const uchar *)data;
+    const char last = _pattern.at(m - 1);
+    for (qint64 idx = from; idx <= (size - m); idx += _skip[udata[idx + m - 1]])
+        if ((data[idx + m - 1] == last) && matchAt(data + idx))
+            return idx;
+    return -1;
+}
+
+qint64 SearchEngine::lastIndexHorspool(const char *data, qint64 size, qint64 from) const
+{
+    Q_UNUSED(size);
+    const uchar *udata = (const uchar *)data;
+    const char first = _pattern.at(0);
+    for (qint64 idx = from; idx >= 0; idx -= _skipBack[udata[idx]])
+        if ((data[idx] == first) && matchAt(data + idx))
+            return idx;
+    return -1;
+}
+
+#ifdef MODUL_TEST
+void SearchEngine::setPlain(bool plain)
+{
+    plainSearch = plain;
+}
+#endif
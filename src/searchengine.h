@@ -0,0 +1,79 @@
+#ifndef SEARCHENGINE_H
+#define SEARCHENGINE_H
+
+/** \cond docNever */
+
+/*! SearchEngine finds a byte pattern in plain memory buffers.
+ *
+ * The pattern is found with a vectorized filter: 16 (SSE2) or 32 (AVX2) positions are
+ * tested at once, if they hold the first and the last byte of the pattern. Only these
+ * candidates are compared completely. Without SSE2 (or with SEARCH_NO_SIMD defined)
+ * short patterns use a scalar version of the filter and long patterns the
+ * Boyer-Moore-Horspool algorithm, its skip table lets the search jump over most of
+ * the data.
+ *
+ * Data, which is split into pieces like the copied chunks and the source data of
+ * Chunks, is searched through a SearchSource. Every piece is searched where it is,
+ * only the few bytes around the borders are copied to find matches crossing them.
+ */
+
+#include <QtCore>
+
+#include "matchindex.h"
+
+class SearchSource
+{
+public:
+    virtual ~SearchSource() {}
+
+    // Gives back the size of a piece of data starting at pos (ending at pos, when
+    // going backward), which is not longer than maxSize. segment points to the data,
+    // buffer can be used to hold it. 0 means there is no more data.
+    virtual qint64 readSegment(qint64 pos, qint64 maxSize, bool backward, const char *&segment, QByteArray &buffer) = 0;
+};
+
+class SearchEngine
+{
+public:
+    SearchEngine(const QByteArray &pattern);
+
+    const QByteArray &pattern() const;
+    int size() const;
+
+    // First match starting at or behind from, -1 if there is none
+    qint64 indexIn(const char *data, qint64 size, qint64 from=0) const;
+
+    // Last match starting at or in front of from, -1 if there is none
+    qint64 lastIndexIn(const char *data, qint64 size, qint64 from) const;
+
+    // First or last match, which lies completely inside of from .. to - 1 of source
+    qint64 indexIn(SearchSource &source, qint64 from, qint64 to) const;
+    qint64 lastIndexIn(SearchSource &source, qint64 from, qint64 to) const;
+
+    // Appends all matches inside of from .. to - 1 of source in one pass. Without
+    // overlapping, the search goes on behind every match like a replacement does.
+    void indexAll(SearchSource &source, qint64 from, qint64 to, MatchIndex &matches, bool overlapping=true) const;
+
+private:
+    qint64 indexFilter(const char *data, qint64 size, qint64 from) const;
+    qint64 lastIndexFilter(const char *data, qint64 size, qint64 from) const;
+    qint64 indexHorspool(const char *data, qint64 size, qint64 from) const;
+    qint64 lastIndexHorspool(const char *data, qint64 size, qint64 from) const;
+    bool matchAt(const char *data) const;
+
+    QByteArray _pattern;
+    bool _vector;                               // SSE2 and AVX2 filters are used
+    bool _horspool;
+    int _skip[256];                             // shifts for forward search
+    int _skipBack[256];                         // shifts for backward search
+
+#ifdef MODUL_TEST
+public:
+    // New engines search without vector filters, like a build without SSE2 does
+    static void setPlain(bool plain);
+#endif
+};
+
+/** \endcond docNever */
+
+#endif // SEARCHENGINE_H
@@ -0,0 +1,332 @@
+#include "viewloader.h"
+
+#define READ_SIZE 0x10000
+
+
+// ***************************************** Reading in the pool
+
+class LoadWorker: public QRunnable
+{
+public:
+    LoadWorker(ViewLoader *loader)
+    {
+        _loader = loader;
+    }
+
+    void run()
+    {
+        _loader->run();
+    }
+
+private:
+    ViewLoader *_loader;
+};
+
+
+// ***************************************** Constructor, destructor
+
+ViewLoader::ViewLoader(QObject *parent)
+    : QObject(parent)
+{
+    _pool.setMaxThreadCount(1);
+    _running = false;
+    _canceled = false;
+    _pos = 0;
+    _size = 0;
+    _waiting = false;
+    _nextPos = 0;
+    _nextSize = 0;
+}
+
+ViewLoader::~ViewLoader()
+{
+    cancel();
+    _pool.waitForDone();
+}
+
+
+// ***************************************** Requests
+
+void ViewLoader::load(const ChunksSnapshot &snapshot, qint64 pos, qint64 size)
+{
+    QMutexLocker locker(&_mutex);
+    if (!_running)
+    {
+        _snapshot = snapshot;
+        _pos = pos;
+        _size = size;
+        _canceled = false;
+        _running = true;
+        _pool.start(new LoadWorker(this));
+    }
+    else if (_canceled || (pos < _pos) || ((pos + size) > (_pos + _size)))
+    {
+        _canceled = true;
+        _nextSnapshot = snapshot;
+        _nextPos = pos;
+        _nextSize = size;
+        _waiting = true;
+    }
+    else
+        _waiting = false;                       // the running read serves this one too
+}
+
+void ViewLoader::cancel()
+{
+    QMutexLocker locker(&_mutex);
+    _canceled = true;
+    _waiting = false;
+    _nextSnapshot.pieces.clear();
+}
+
+bool ViewLoader::canceled()
+{
+    QMutexLocker locker(&_mutex);
+    return _canceled;
+}
+
+
+// ***************************************** Reading a snapshot
+
+QByteArray ViewLoader::read(const ChunksSnapshot &snapshot, qint64 pos, qint64 size,
+                            QByteArray *highlighted, ViewLoader *loader)
+{
+    QByteArray data;
+    if (highlighted)
+        highlighted->clear();
+    qint64 end = qMin(pos + size, snapshot.size);
+    if (!snapshot.valid || (pos < 0) || (pos >= end))
+        return data;
+    data.resize((int)(end - pos));
+    QByteArray changed(data.size(), char(0));
+
+    // Binary search of the last piece starting at pos
+    const QVector<SnapshotPiece> &pieces = snapshot.pieces;
+    int lo = 0;
+    int hi = pieces.size() - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1) / 2;
+        if (pieces.at(mid).pos <= pos)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    QFile file;
+    for (int idx=lo; (idx < pieces.size()) && (pieces.at(idx).pos < end); idx++)
+    {
+        const SnapshotPiece &piece = pieces.at(idx);
+        qint64 start = qMax(pos, piece.pos);
+        qint64 stop = qMin(end, piece.pos + piece.size);
+        if (start >= stop)
+            continue;
+        char *target = data.data() + (start - pos);
+
+        if (piece.spillPos >= 0)
+        {
+            QByteArray spilled = snapshot.spill->read(piece.spillPos + (start - piece.pos), (int)(stop - start));
+            if (spilled.size() != (stop - start))
+                return QByteArray();
+            memcpy(target, spilled.constData(), stop - start);
+            piece.dataChanged.copyBytes(changed.data() + (start - pos), (int)(start - piece.pos), (int)(stop - start));
+            continue;
+        }
+        if (piece.srcPos < 0)
+        {
+            memcpy(target, piece.data.constData() + (start - piece.pos), stop - start);
+            piece.dataChanged.copyBytes(changed.data() + (start - pos), (int)(start - piece.pos), (int)(stop - start));
+            continue;
+        }
+
+        qint64 srcStart = piece.srcPos + (start - piece.pos);
+        if (snapshot.fileName.isEmpty())
+        {
+            if ((srcStart + (stop - start)) > snapshot.buffer.size())
+                return QByteArray();            // source was truncated externally
+            memcpy(target, snapshot.buffer.constData() + srcStart, stop - start);
+            continue;
+        }
+
+        // Slow devices are read in blocks, so a canceled read ends soon
+        if (!file.isOpen())
+        {
+            file.setFileName(snapshot.fileName);
+            if (!file.open(QIODevice::ReadOnly))
+                return QByteArray();
+        }
+        for (qint64 done=0; done < (stop - start); done += READ_SIZE)
+        {
+            if (loader && loader->canceled())
+                return QByteArray();
+            qint64 count = qMin<qint64>(READ_SIZE, stop - start - done);
+            if (!file.seek(srcStart + done) || (file.read(target + done, count) < count))
+                return QByteArray();
+        }
+    }
+
+    if (highlighted)
+        *highlighted = changed;
+    return data;
+}
+
+
+// ***************************************** Private utility functions
+
+void ViewLoader::run()
+{
+    _mutex.lock();
+    ChunksSnapshot snapshot = _snapshot;
+    qint64 pos = _pos;
+    qint64 size = _size;
+    _mutex.unlock();
+
+    QByteArray highlighted;
+    QByteArray data = read(snapshot, pos, size, &highlighted, this);
+
+    _mutex.lock();
+    _data = data;
+    _highlighted = highlighted;
+    _mutex.unlock();
+    QMetaObject::invokeMethod(this, "readFinished", Qt::QueuedConnection);
+}
+
+void ViewLoader::readFinished()
+{
+    _mutex.lock();
+    bool deliver = !_canceled;
+    qint64 pos = _pos;
+    QByteArray data = _data;
+    QByteArray highlighted = _highlighted;
+    _data.clear();
+    _highlighted.clear();
+    if (_waiting)
+    {
+        // The latest request only, all others in between were replaced
+        _snapshot = _nextSnapshot;
+        _pos = _nextPos;
+        _size = _nextSize;
+        _nextSnapshot.pieces.clear();
+        _waiting = false;
+        _canceled = false;
+        _pool.start(new LoadWorker(this));
+    }
+    else
+    {
+        _snapshot.pieces.clear();               // releases the shared chunks
+        _running = false;
+    }
+    _mutex.unlock();
+
+    if (deliver)
+        emit loaded(pos, data, highlighted);
+}
+
+#ifdef MODUL_TEST
+void ViewLoader::waitForLoaded()
+{
+    // readFinished() is queued, it may start the waiting request
+    forever
+    {
+        _pool.waitForDone();
+        QCoreApplication::processEvents();
+        QMutexLocker locker(&_mutex);
+        if (!_running)
+            return;
+    }
+}
+#endif
+
+
+// ***************************************** ViewPrefetch
+
+ViewPrefetch::ViewPrefetch()
+{
+    _screens = 4;
+    _budget = 0x40000;
+    _direction = 0;
+    _step = 0;
+    _requested = 0;
+    _requestedEnd = 0;
+    _hits = 0;
+    _misses = 0;
+}
+
+void ViewPrefetch::setScreens(int screens)
+{
+    _screens = qMax(screens, 0);
+}
+
+int ViewPrefetch::screens() const
+{
+    return _screens;
+}
+
+void ViewPrefetch::setBudget(qint64 budget)
+{
+    _budget = qMax<qint64>(budget, 0);
+}
+
+qint64 ViewPrefetch::budget() const
+{
+    return _budget;
+}
+
+void ViewPrefetch::moved(qint64 pos, qint64 newPos, bool complete)
+{
+    if (pos == newPos)
+        return;
+    _step = qAbs(newPos - pos);
+    _direction = (newPos > pos) ? 1 : -1;
+    if (complete)
+        _hits += 1;
+    else
+        _misses += 1;
+}
+
+void ViewPrefetch::setRequested(qint64 begin, qint64 end)
+{
+    _requested = begin;
+    _requestedEnd = end;
+}
+
+bool ViewPrefetch::request(qint64 pos, qint64 size, int line, qint64 dataSize, qint64 &begin, qint64 &end)
+{
+    // A drag of the scroll bar makes big moves, so the moves ahead are as big as the
+    // last one. The budget cuts both sides alike.
+    qint64 ahead = _screens * qMax(size, _step);
+    qint64 behind = (_direction == 0) ? ahead / 2 : ahead / 4;
+    if (_direction == 0)
+        ahead /= 2;
+    if ((ahead + behind) > _budget)
+    {
+        behind = (ahead + behind > 0) ? behind * _budget / (ahead + behind) : 0;
+        ahead = _budget - behind;
+    }
+
+    qint64 reserve = qMin(2 * qMax<qint64>(_step, line), ahead);
+    qint64 needBegin = qMax<qint64>(pos - ((_direction <= 0) ? reserve : 0), 0);
+    qint64 needEnd = qMin(pos + size + ((_direction >= 0) ? reserve : 0), dataSize);
+    if ((needBegin >= _requested) && (needEnd <= _requestedEnd))
+        return false;
+    _requested = qMax<qint64>(pos - ((_direction < 0) ? ahead : behind), 0);
+    _requestedEnd = qMin(pos + size + ((_direction < 0) ? behind : ahead), dataSize);
+    begin = _requested;
+    end = _requestedEnd;
+    return true;
+}
+
+int ViewPrefetch::direction() const
+{
+    return _direction;
+}
+
+qint64 ViewPrefetch::hits() const
+{
+    return _hits;
+}
+
+qint64 ViewPrefetch::misses() const
+{
+    return _misses;
+}
@@ -0,0 +1,118 @@
+#ifndef VIEWLOADER_H
+#define VIEWLOADER_H
+
+/** \cond docNever */
+
+/*! ViewLoader reads the bytes around the view of QHexEdit in a thread.
+ *
+ * QHexEdit asks for a range with load() and passes a snapshot of Chunks for it, so a
+ * slow device is read without blocking the GUI. One range is read at a time. A request,
+ * which comes in meanwhile, waits and replaces the one waiting before, so the fast
+ * scrolling user gets the latest range only. A running read, which does not cover the
+ * new range, is canceled. loaded() is emitted in the thread of the loader and never
+ * for canceled reads. An empty result means, the source could not be read.
+ */
+
+#include <QtCore>
+#include <QFile>
+#include <QMutex>
+#include <QThreadPool>
+
+#include "chunks.h"
+
+class ViewLoader: public QObject
+{
+    Q_OBJECT
+public:
+    ViewLoader(QObject *parent=0);
+    ~ViewLoader();
+
+    void load(const ChunksSnapshot &snapshot, qint64 pos, qint64 size);
+    void cancel();                              // drops the running and the waiting request
+    bool canceled();
+
+    // Same result as Chunks::data(), read out of a snapshot, which covers the range.
+    // Stops with an empty result, when loader is canceled.
+    static QByteArray read(const ChunksSnapshot &snapshot, qint64 pos, qint64 size,
+                           QByteArray *highlighted=0, ViewLoader *loader=0);
+
+signals:
+    void loaded(qint64 pos, const QByteArray &data, const QByteArray &highlighted);
+
+private slots:
+    void readFinished();
+
+private:
+    Q_DISABLE_COPY(ViewLoader)
+    friend class LoadWorker;
+
+    void run();                                 // runs in _pool
+
+    QThreadPool _pool;
+    QMutex _mutex;                              // guards all of the following
+    bool _running;
+    bool _canceled;
+    ChunksSnapshot _snapshot;                   // running request
+    qint64 _pos;
+    qint64 _size;
+    bool _waiting;
+    ChunksSnapshot _nextSnapshot;               // waiting request
+    qint64 _nextPos;
+    qint64 _nextSize;
+    QByteArray _data;                           // result of the running request
+    QByteArray _highlighted;
+
+#ifdef MODUL_TEST
+public:
+    void waitForLoaded();                       // all requests are delivered or dropped
+#endif
+};
+
+/*! ViewPrefetch decides, which range around the view ViewLoader reads.
+ *
+ * It follows the moves of the view. In the direction of the last move, it keeps
+ * screens() moves ahead, each of them at least a screen, behind it keeps a quarter of
+ * that. Without a move, both sides get half of it. The budget limits the bytes
+ * beyond the view. A new range is requested, before two more moves like the last
+ * one would leave the requested one, so a loader, which is one move late, still
+ * keeps up. Every move counts as a hit, if all bytes in view were loaded.
+ */
+
+class ViewPrefetch
+{
+public:
+    ViewPrefetch();
+
+    void setScreens(int screens);
+    int screens() const;
+    void setBudget(qint64 budget);
+    qint64 budget() const;
+
+    // The view moved from pos to newPos, complete is true, if all bytes were loaded
+    void moved(qint64 pos, qint64 newPos, bool complete);
+
+    // begin .. end - 1 is loaded already, e.g. the view was read at once
+    void setRequested(qint64 begin, qint64 end);
+
+    // Range to load for the view at pos with size bytes and lines of line bytes,
+    // false, if the range requested before is still enough
+    bool request(qint64 pos, qint64 size, int line, qint64 dataSize, qint64 &begin, qint64 &end);
+
+    int direction() const;                      // last move: -1, 0, 1
+    qint64 hits() const;
+    qint64 misses() const;
+
+private:
+    int _screens;
+    qint64 _budget;
+    int _direction;
+    qint64 _step;                               // bytes of the last move
+    qint64 _requested;                          // range requested last
+    qint64 _requestedEnd;
+    qint64 _hits;                               // moves without placeholders
+    qint64 _misses;
+};
+
+/** \endcond docNever */
+
+#endif // VIEWLOADER_H
@@ -0,0 +1,380 @@
+#include "benchchunks.h"
+#include <QElapsedTimer>
+
+#define CHUNK_SIZE 0x1000
+#define READ_CHUNK_MASK Q_INT64_C(0xfffffffffffff000)
+
+
+// The list based chunk bookkeeping, which was used before ChunkTree. It is kept
+// here as reference for the benchmarks.
+
+struct ListChunk
+{
+    QByteArray data;
+    QByteArray dataChanged;
+    qint64 absPos;
+};
+
+class ChunkList
+{
+public:
+    ChunkList(QIODevice &ioDevice)
+    {
+        _ioDevice = &ioDevice;
+        _ioDevice->open(QIODevice::ReadOnly);
+        _size = _ioDevice->size();
+        _ioDevice->close();
+    }
+
+    void insert(qint64 pos, char b)
+    {
+        int chunkIdx = getChunkIndex(pos);
+        qint64 posInBa = pos - _chunks[chunkIdx].absPos;
+        _chunks[chunkIdx].data.insert((int)posInBa, b);
+        _chunks[chunkIdx].dataChanged.insert((int)posInBa, char(1));
+        for (int idx=chunkIdx+1; idx < _chunks.size(); idx++)
+            _chunks[idx].absPos += 1;
+        _size += 1;
+    }
+
+    void overwrite(qint64 pos, char b)
+    {
+        int chunkIdx = getChunkIndex(pos);
+        qint64 posInBa = pos - _chunks[chunkIdx].absPos;
+        _chunks[chunkIdx].data[(int)posInBa] = b;
+        _chunks[chunkIdx].dataChanged[(int)posInBa] = char(1);
+    }
+
+    void removeAt(qint64 pos)
+    {
+        int chunkIdx = getChunkIndex(pos);
+        qint64 posInBa = pos - _chunks[chunkIdx].absPos;
+        _chunks[chunkIdx].data.remove((int)posInBa, 1);
+        _chunks[chunkIdx].dataChanged.remove((int)posInBa, 1);
+        for (int idx=chunkIdx+1; idx < _chunks.size(); idx++)
+            _chunks[idx].absPos -= 1;
+        _size -= 1;
+    }
+
+    qint64 size()
+    {
+        return _size;
+    }
+
+private:
+    int getChunkIndex(qint64 absPos)
+    {
+        int foundIdx = -1;
+        int insertIdx = 0;
+        qint64 ioDelta = 0;
+
+        for (int idx=0; idx < _chunks.size(); idx++)
+        {
+            const ListChunk &chunk = _chunks[idx];
+            if ((absPos >= chunk.absPos) && (absPos < (chunk.absPos + chunk.data.size())))
+            {
+                foundIdx = idx;
+                break;
+            }
+            if (absPos < chunk.absPos)
+            {
+                insertIdx = idx;
+                break;
+            }
+            ioDelta += chunk.data.size() - CHUNK_SIZE;
+            insertIdx = idx + 1;
+        }
+
+        if (foundIdx == -1)
+        {
+            ListChunk newChunk;
+            qint64 readAbsPos = absPos - ioDelta;
+            qint64 readPos = (readAbsPos & READ_CHUNK_MASK);
+            _ioDevice->open(QIODevice::ReadOnly);
+            _ioDevice->seek(readPos);
+            newChunk.data = _ioDevice->read(CHUNK_SIZE);
+            _ioDevice->close();
+            newChunk.absPos = absPos - (readAbsPos - readPos);
+            newChunk.dataChanged = QByteArray(newChunk.data.size(), char(0));
+            _chunks.insert(insertIdx, newChunk);
+            foundIdx = insertIdx;
+        }
+        return foundIdx;
+    }
+
+    QIODevice *_ioDevice;
+    qint64 _size;
+    QList<ListChunk> _chunks;
+};
+
+
+// ***************************************** Benchmarks
+
+BenchChunks::BenchChunks(QTextStream &log, qint64 fileSize)
+{
+    // A sparse file, so even big sizes do not cost disk space
+    _file.open();
+    _file.resize(fileSize);
+    _file.close();
+    _fileSize = fileSize;
+    _seed = Q_UINT64_C(88172645463325252);
+    _log = &log;
+}
+
+void BenchChunks::edits(int count, int legacyCount)
+{
+    // Random inserts, overwrites and removes, legacyCount of them are also done
+    // with the list based implementation, which needs much more time.
+
+    QElapsedTimer timer;
+    Chunks chunks(_file, 0);
+
+    _seed = Q_UINT64_C(88172645463325252);
+    timer.start();
+    for (int idx=0; idx < count; idx++)
+    {
+        qint64 pos = random() % (chunks.size() - 1);
+        switch (idx % 3)
+        {
+        case 0:
+            chunks.insert(pos, char(idx));
+            break;
+        case 1:
+            chunks.overwrite(pos, char(idx));
+            break;
+        case 2:
+            chunks.removeAt(pos);
+            break;
+        }
+        if ((idx + 1) == legacyCount)
+            report(QString("ChunkTree, %1 chunks").arg(chunks.chunkSize()), legacyCount, timer.nsecsElapsed());
+    }
+    report(QString("ChunkTree, %1 chunks").arg(chunks.chunkSize()), count, timer.nsecsElapsed());
+
+    ChunkList chunkList(_file);
+    _seed = Q_UINT64_C(88172645463325252);
+    timer.start();
+    for (int idx=0; idx < legacyCount; idx++)
+    {
+        qint64 pos = random() % (chunkList.size() - 1);
+        switch (idx % 3)
+        {
+        case 0:
+            chunkList.insert(pos, char(idx));
+            break;
+        case 1:
+            chunkList.overwrite(pos, char(idx));
+            break;
+        case 2:
+            chunkList.removeAt(pos);
+            break;
+        }
+    }
+    report("QList<Chunk>", legacyCount, timer.nsecsElapsed());
+}
+
+
+void BenchChunks::search(qint64 dataSize)
+{
+    // Random lower case letters, so the first and last byte of a pattern match
+    // often. The patterns are only found at the very end (indexOf) or at the very
+    // beginning (lastIndexOf), so the whole data is scanned.
+
+    QTemporaryFile file;
+    file.open();
+    QByteArray block(0x100000, 'a');
+    _seed = Q_UINT64_C(88172645463325252);
+    for (qint64 pos=0; pos < dataSize; pos += block.size())
+    {
+        for (int idx=0; idx < block.size(); idx++)
+            block[idx] = char('a' + random() % 26);
+        file.write(block.constData(), qMin<qint64>(block.size(), dataSize - pos));
+    }
+
+    QList<int> sizes = QList<int>() << 8 << 16 << 64 << 256;
+    foreach (int size, sizes)
+    {
+        QByteArray pattern;
+        for (int idx=0; idx < size; idx++)
+            pattern += char('a' + random() % 26);
+        file.seek(dataSize - size);
+        file.write(pattern);
+        file.seek(0);
+        file.write(pattern);
+        file.flush();
+
+        QElapsedTimer timer;
+        for (int mapped=0; mapped < 2; mapped++)
+        {
+            Chunks chunks(file, 0);
+            chunks.setMemoryMapped(mapped == 1);
+            QString mode = (mapped == 1) ? "mapped" : "read";
+
+            timer.start();
+            qint64 found = chunks.indexOf(pattern, 1);
+            qint64 nsecs = timer.nsecsElapsed();
+            if (found != (dataSize - size))
+                qDebug() << "indexOf failed" << found;
+            reportThroughput("search", QString("indexOf, %1 bytes, %2").arg(size).arg(mode), dataSize, nsecs);
+
+            timer.start();
+            found = chunks.lastIndexOf(pattern, dataSize - 1);
+            nsecs = timer.nsecsElapsed();
+            if (found != 0)
+                qDebug() << "lastIndexOf failed" << found;
+            reportThroughput("search", QString("lastIndexOf, %1 bytes, %2").arg(size).arg(mode), dataSize, nsecs);
+
+            timer.start();
+            found = ParallelSearch(chunks.snapshot(), pattern).indexOf(1);
+            nsecs = timer.nsecsElapsed();
+            if (found != (dataSize - size))
+                qDebug() << "parallel indexOf failed" << found;
+            reportThroughput("search", QString("parallel indexOf, %1 bytes, %2, %3 threads").arg(size).arg(mode)
+                             .arg(QThreadPool::globalInstance()->maxThreadCount()), dataSize, nsecs);
+
+            timer.start();
+            found = ParallelSearch(chunks.snapshot(), pattern).lastIndexOf(dataSize - 1);
+            nsecs = timer.nsecsElapsed();
+            if (found != 0)
+                qDebug() << "parallel lastIndexOf failed" << found;
+            reportThroughput("search", QString("parallel lastIndexOf, %1 bytes, %2, %3 threads").arg(size).arg(mode)
+                             .arg(QThreadPool::globalInstance()->maxThreadCount()), dataSize, nsecs);
+        }
+
+        // The way Chunks searched before: copying 64 KiB pieces out and search them
+        Chunks chunks(file, 0);
+        timer.start();
+        qint64 found = -1;
+        for (qint64 pos=1; (pos < dataSize) && (found < 0); pos += 0x10000)
+        {
+            int idx = chunks.data(pos, 0x10000 + size - 1).indexOf(pattern);
+            if (idx >= 0)
+                found = pos + idx;
+        }
+        reportThroughput("search", QString("data() + QByteArray::indexOf, %1 bytes").arg(size), dataSize, timer.nsecsElapsed());
+    }
+}
+
+void BenchChunks::replaceAll(int count, int legacyCount)
+{
+    // A sparse file with count patterns spread evenly, they are replaced by a longer
+    // byte array in one step and one by one, like the search dialog did before.
+
+    QByteArray pattern("\x01\x02\x03\x04");
+    QByteArray replacement("\x05\x06\x07\x08\x09");
+    QTemporaryFile file;
+    file.open();
+    file.resize(_fileSize);
+    qint64 distance = _fileSize / count;
+    for (qint64 pos=0; (pos + pattern.size()) <= _fileSize; pos += distance)
+    {
+        file.seek(pos);
+        file.write(pattern);
+    }
+    file.flush();
+
+    QElapsedTimer timer;
+    {
+        Chunks chunks(file, 0);
+        timer.start();
+        MatchIndex positions;
+        int found = (int)chunks.indexAll(pattern, positions, false);
+        chunks.replaceAll(positions, pattern.size(), replacement);
+        report(QString("replaceAll, %1 chunks").arg(chunks.chunkSize()), found, timer.nsecsElapsed());
+    }
+
+    Chunks chunks(file, 0);
+    timer.start();
+    qint64 pos = 0;
+    for (int idx=0; idx < legacyCount; idx++)
+    {
+        pos = chunks.indexOf(pattern, pos);
+        if (pos < 0)
+            break;
+        chunks.remove(pos, pattern.size());
+        chunks.insert(pos, replacement);
+        pos += replacement.size();
+    }
+    report("indexOf + remove + insert", legacyCount, timer.nsecsElapsed());
+}
+
+
+void BenchChunks::write(qint64 dataSize, int edits)
+{
+    // A sparse file with edits spread over it is saved to a real file, streamed by
+    // write() and in 64 KiB pieces out of data(), like write() did before.
+
+    QTemporaryFile file;
+    file.open();
+    file.resize(dataSize);
+    file.close();
+
+    QElapsedTimer timer;
+    for (int mapped=0; mapped < 2; mapped++)
+    {
+        Chunks chunks(file, 0);
+        chunks.setMemoryMapped(mapped == 1);
+        QString mode = (mapped == 1) ? "mapped" : "read";
+        _seed = Q_UINT64_C(88172645463325252);
+        for (int idx=0; idx < edits; idx++)
+        {
+            qint64 pos = random() % (chunks.size() - 1);
+            if (idx % 2)
+                chunks.insert(pos, QByteArray(idx % 100 + 1, char(idx)));
+            else
+                chunks.overwrite(pos, QByteArray(idx % 100 + 1, char(idx)));
+        }
+
+        // The first write pays for warming up the page cache, it is not counted. Every
+        // output is removed, before the next one is written, so one copy is on disk.
+        {
+            QTemporaryFile out;
+            out.open();
+            out.close();
+            chunks.write(out);
+            timer.start();
+            if (!chunks.write(out))
+                qDebug() << "write failed";
+            reportThroughput("write", QString("%1 edits, %2").arg(edits).arg(mode), chunks.size(), timer.nsecsElapsed());
+        }
+
+        QTemporaryFile outPieces;
+        outPieces.open();
+        timer.start();
+        for (qint64 pos=0; pos < chunks.size(); pos += 0x10000)
+            outPieces.write(chunks.data(pos, 0x10000));
+        outPieces.close();
+        reportThroughput("write", QString("%1 edits, %2, data() + QIODevice::write").arg(edits).arg(mode),
+                         chunks.size(), timer.nsecsElapsed());
+    }
+}
+
+
+// ***************************************** Private utility functions
+
+qint64 BenchChunks::random()
+{
+    // xorshift64, rand() has only 15 bits on some platforms
+    _seed ^= _seed << 13;
+    _seed ^= _seed >> 7;
+    _seed ^= _seed << 17;
+    return (qint64)(_seed >> 1);
+}
+
+void BenchChunks::report(const QString &name, int count, qint64 nsecs)
+{
+    QString line = QString("%1 edits on %2 MiB, %3: %4 ms, %5 us/edit")
+            .arg(count).arg(_fileSize / 0x100000).arg(name)
+            .arg(nsecs / 1000000).arg((double)nsecs / 1000. / count, 0, 'f', 2);
+    qDebug() << line;
+    *_log << line << "\n";
+}
+
+void BenchChunks::reportThroughput(const QString &task, const QString &name, qint64 bytes, qint64 nsecs)
+{
+    QString line = QString("%1 %2 MiB, %3: %4 ms, %5 GB/s")
+            .arg(task).arg(bytes / 0x100000).arg(name)
+            .arg(nsecs / 1000000).arg((double)bytes / qMax<qint64>(nsecs, 1), 0, 'f', 2);
+    qDebug() << line;
+    *_log << line << "\n";
+}
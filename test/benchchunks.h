@@ -0,0 +1,30 @@
+#ifndef BENCHCHUNKS_H
+#define BENCHCHUNKS_H
+
+#include <QTemporaryFile>
+#include <QTextStream>
+
+#include "../src/chunks.h"
+#include "../src/parallelsearch.h"
+
+class BenchChunks
+{
+public:
+    BenchChunks(QTextStream &log, qint64 fileSize);
+    void edits(int count, int legacyCount);
+    void search(qint64 dataSize);
+    void replaceAll(int count, int legacyCount);
+    void write(qint64 dataSize, int edits);
+
+private:
+    qint64 random();
+    void report(const QString &name, int count, qint64 nsecs);
+    void reportThroughput(const QString &task, const QString &name, qint64 bytes, qint64 nsecs);
+
+    QTemporaryFile _file;
+    qint64 _fileSize;
+    quint64 _seed;
+    QTextStream *_log;
+};
+
+#endif // BENCHCHUNKS_H
@@ -0,0 +1,84 @@
+#include <QApplication>
+#include <QtCore>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QScrollBar>
+
+#include "../src/qhexedit.h"
+
+
+static void report(QTextStream &log, const QString &name, int frames, qint64 nsecs)
+{
+    QString line = QString("%1: %2 frames, %3 ms, %4 fps")
+            .arg(name).arg(frames).arg(nsecs / 1000000)
+            .arg((double)frames * 1000000000. / qMax<qint64>(nsecs, 1), 0, 'f', 1);
+    qDebug() << line;
+    log << line << "\n";
+}
+
+static void scroll(QTextStream &log, QHexEdit &hexEdit, QAbstractSlider::SliderAction action, const QString &name, int frames)
+{
+    QElapsedTimer timer;
+    QScrollBar *scrollBar = hexEdit.verticalScrollBar();
+    scrollBar->setValue(0);
+    timer.start();
+    for (int frame=0; frame < frames; frame++)
+    {
+        if (scrollBar->value() == scrollBar->maximum())
+            scrollBar->setValue(0);
+        scrollBar->triggerAction(action);
+        QApplication::processEvents();          // paints the invalidated region only
+    }
+    report(log, name, frames, timer.nsecsElapsed());
+}
+
+int main(int argc, char *argv[])
+{
+    // paint [frames] [bytes per line] [width] [height]
+    QApplication app(argc, argv);
+    int frames = (argc > 1) ? QByteArray(argv[1]).toInt() : 500;
+    int bytesPerLine = (argc > 2) ? QByteArray(argv[2]).toInt() : 64;
+    int width = (argc > 3) ? QByteArray(argv[3]).toInt() : 3840;
+    int height = (argc > 4) ? QByteArray(argv[4]).toInt() : 2160;
+
+    QDir().mkpath("logs");
+    QFile outFile("logs/PaintBenchmark.log");
+    outFile.open(QIODevice::WriteOnly | QIODevice::Text);
+    QTextStream paintLog(&outFile);
+
+    // All bytes occur, some are selected, highlighted or matches
+    QByteArray data(0x400000, 0);
+    quint64 seed = 0x9e3779b97f4a7c15ULL;
+    for (int idx=0; idx < data.size(); idx++)
+    {
+        seed ^= seed << 13;
+        seed ^= seed >> 7;
+        seed ^= seed << 17;
+        data[idx] = char(seed >> 56);
+    }
+
+    QHexEdit hexEdit;
+    hexEdit.resize(width, height);
+    hexEdit.setBytesPerLine(bytesPerLine);
+    hexEdit.setData(data);
+    hexEdit.beginEdit();
+    for (int pos=0; pos < data.size(); pos += 97)
+        hexEdit.replace(pos, data.at(pos));
+    hexEdit.endEdit();
+    hexEdit.findAll(data.mid(0x1000, 1));
+    hexEdit.indexOf(data.mid(0x2000, 16), 0);
+    hexEdit.show();
+    app.processEvents();
+
+    QString size = QString("%1x%2, %3 bytes per line").arg(width).arg(height).arg(bytesPerLine);
+    for (int atlas=0; atlas < 2; atlas++)
+    {
+        hexEdit.setGlyphAtlas(atlas != 0);
+        QString name = size + (atlas ? ", glyph atlas" : ", drawText");
+        scroll(paintLog, hexEdit, QAbstractSlider::SliderSingleStepAdd, "line steps, " + name, frames);
+        scroll(paintLog, hexEdit, QAbstractSlider::SliderPageStepAdd, "page steps, " + name, frames);
+    }
+
+    outFile.close();
+    return 0;
+}
@@ -4,15 +4,33 @@
 #
 #-------------------------------------------------
 
-#greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 DEFINES += MODUL_TEST
 
 SOURCES += \
     main.cpp \
     ../src/chunks.cpp \
-    testchunks.cpp
+    ../src/chunktree.cpp \
+    ../src/changedbits.cpp \
+    ../src/chunkspill.cpp \
+    ../src/commands.cpp \
+    ../src/searchengine.cpp \
+    ../src/parallelsearch.cpp \
+    ../src/matchindex.cpp \
+    ../src/viewloader.cpp \
+    testchunks.cpp \
+    benchchunks.cpp
 
 HEADERS += \
     ../src/chunks.h \
-    testchunks.h
+    ../src/chunktree.h \
+    ../src/changedbits.h \
+    ../src/chunkspill.h \
+    ../src/commands.h \
+    ../src/searchengine.h \
+    ../src/parallelsearch.h \
+    ../src/matchindex.h \
+    ../src/viewloader.h \
+    testchunks.h \
+    benchchunks.h
@@ -3,10 +3,40 @@
 #include <QDir>
 
 #include "testchunks.h"
+#include "benchchunks.h"
 
 
-int main()
+int bench(int argc, char *argv[])
 {
+    // chunks bench [fileSize MiB] [edits] [edits with QList<Chunk>] [search MiB] [replacements] [write MiB]
+    qint64 fileSize = (argc > 2) ? QByteArray(argv[2]).toLongLong() : 1024;
+    int edits = (argc > 3) ? QByteArray(argv[3]).toInt() : 1000000;
+    int legacyEdits = (argc > 4) ? QByteArray(argv[4]).toInt() : 20000;
+    qint64 searchSize = (argc > 5) ? QByteArray(argv[5]).toLongLong() : 256;
+    int replacements = (argc > 6) ? QByteArray(argv[6]).toInt() : 1000000;
+    qint64 writeSize = (argc > 7) ? QByteArray(argv[7]).toLongLong() : 1024;
+
+    QDir().mkpath("logs");
+    QFile outFile("logs/Benchmark.log");
+    outFile.open(QIODevice::WriteOnly | QIODevice::Text);
+    QTextStream benchLog(&outFile);
+
+    BenchChunks bc(benchLog, fileSize * 0x100000);
+    bc.edits(edits, qMin(edits, legacyEdits));
+    bc.search(searchSize * 0x100000);
+    bc.replaceAll(replacements, qMin(replacements, legacyEdits));
+    bc.write(writeSize * 0x100000, 10000);
+
+    outFile.close();
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);           // queued signals of the threads
+    if ((argc > 1) && (QByteArray(argv[1]) == "bench"))
+        return bench(argc, argv);
+
     QDir dir("logs");
     dir.setNameFilters(QStringList() << "*.*");
     dir.setFilter(QDir::Files);
@@ -57,6 +87,60 @@ int main()
 
     TestChunks tc4(sumLog, "random", 0x40000, true);
     tc4.random(1000);
+    tc4.search(200);
+    tc4.replaceAll(20);
+
+    // The same without the vector filters, long patterns are searched by Horspool
+    SearchEngine::setPlain(true);
+    tc4.search(200);
+    SearchEngine::setPlain(false);
+
+    TestChunks tc5(sumLog, "blocks", 0x40000, true);
+    tc5.randomBlocks(1000);
+    tc5.search(200);
+    tc5.replaceAll(20);
+
+    // Sparse files of 5 GiB need a file system, which supports them: chunks big
+    if ((argc > 1) && (QByteArray(argv[1]) == "big"))
+    {
+        tc5.bigFile(Q_INT64_C(0x140000000));
+        tc5.bigEdits(Q_INT64_C(0x140000000));
+    }
+
+    // Few edits, so the views are mostly source data
+    TestChunks tc6(sumLog, "view", 0x100000, true);
+    tc6.randomBlocks(20);
+    tc6.viewLoader(200);
+    tc6.viewRequests();
+    tc6.viewPrefetch(50);
+
+    // A budget of 16 chunks, searches and views read spilled chunks
+    TestChunks tc7(sumLog, "spill", 0x40000, true);
+    tc7.memoryBudget(0x10000, 40);
+    tc7.random(40);
+    tc7.search(10);
+    tc7.replaceAll(4);
+    tc7.viewLoader(10);
+    tc7.spillLost();
+
+    // Edits at one place, which are taken back again
+    TestChunks tc8(sumLog, "compaction", 0x40000, true);
+    tc8.compaction(0x3000);
+    tc8.random(200);
+    tc8.compaction(0x800);
+
+    // Overwrites only, which are patched into the source
+    TestChunks tc9(sumLog, "writeChanges", 0x40000, true);
+    tc9.writeChanges(0x10000, 100);
+
+    // Undo steps beyond a budget, compressed by the pool and dropped
+    TestChunks tc10(sumLog, "undoBudget", 0x40000, true);
+    tc10.undoBudget(0x10000, 40);
+
+    // Undo steps of 64 KiB and more in the journal
+    TestChunks tc11(sumLog, "undoJournal", 0x40000, true);
+    tc11.undoJournal(30);
+    tc11.editSteps(100);
 
     outFile.close();
     return 0;
@@ -0,0 +1,35 @@
+#-------------------------------------------------
+#
+# Frames per second of QHexEdit while scrolling
+#
+#-------------------------------------------------
+
+QT += core gui
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+SOURCES += \
+    benchpaint.cpp \
+    ../src/qhexedit.cpp \
+    ../src/chunks.cpp \
+    ../src/chunktree.cpp \
+    ../src/changedbits.cpp \
+    ../src/chunkspill.cpp \
+    ../src/searchengine.cpp \
+    ../src/parallelsearch.cpp \
+    ../src/matchindex.cpp \
+    ../src/viewloader.cpp \
+    ../src/glyphatlas.cpp \
+    ../src/commands.cpp
+
+HEADERS += \
+    ../src/qhexedit.h \
+    ../src/chunks.h \
+    ../src/chunktree.h \
+    ../src/changedbits.h \
+    ../src/chunkspill.h \
+    ../src/searchengine.h \
+    ../src/parallelsearch.h \
+    ../src/matchindex.h \
+    ../src/viewloader.h \
+    ../src/glyphatlas.h \
+    ../src/commands.h
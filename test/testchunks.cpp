@@ -2,6 +2,32 @@
 #include <cstdlib>
 
 
+void ChangeRecorder::contentsChanged(qint64 pos, qint64 removed, qint64 added)
+{
+    change.merge(pos, removed, added);
+}
+
+void ChangeRecorder::indexChanged(int)
+{
+    steps += 1;
+}
+
+void ChangeRecorder::loaded(qint64 pos, const QByteArray &data, const QByteArray &)
+{
+    loadedPos.append(pos);
+    loadedData.append(data);
+}
+
+FileSource::FileSource(const QByteArray &data, qint64 size)
+{
+    file.open();
+    file.write(data);
+    if (size > data.size())
+        file.resize(size);
+    file.close();
+    chunks.setIODevice(file);
+}
+
 TestChunks::TestChunks(QTextStream &log, QString tName, int size, bool random, int saveFile)
 {
     char hex[] = "0123456789abcdef";
@@ -16,7 +42,10 @@ TestChunks::TestChunks(QTextStream &log, QString tName, int size, bool random, i
     }
     _copy = _data;
     _cData.setData(_copy);
+    QObject::connect(&_chunks, SIGNAL(contentsChanged(qint64,qint64,qint64)),
+                     &_recorder, SLOT(contentsChanged(qint64,qint64,qint64)));
     _chunks.setIODevice(_cData);
+    _byteChunks.setIODevice(_cData);
     _tCnt = 0;
     _log = &log;
     _tName = tName;
@@ -46,12 +75,729 @@ void TestChunks::random(int count)
     }
 }
 
+void TestChunks::randomBlocks(int count)
+{
+    // Blocks up to 3 chunks long, so chunks are split and spliced
+    for (int idx=1; idx < count; idx++)
+    {
+        int action = rand() % 3;
+        int pos = rand() % _data.size();
+        int len = rand() % 0x3000 + 1;
+        QByteArray ba;
+        for (int bIdx=0; bIdx < len; bIdx++)
+            ba += char(rand() % 0x100);
+        switch (action)
+        {
+        case 0:
+            remove(pos, qMin(len, _data.size() - pos));
+            break;
+        case 1:
+            insert(pos, ba);
+            break;
+        case 2:
+            overwrite(pos, ba.left(_data.size() - pos));
+            break;
+        }
+    }
+}
+
+void TestChunks::search(int count)
+{
+    // Patterns are cut out of the data, so they are found across chunk borders
+    int errors = 0;
+    for (int idx=0; idx < count; idx++)
+    {
+        int len = (idx % 2) ? rand() % 8 + 1 : rand() % 100 + 1;
+        QByteArray ba = _data.mid(rand() % (_data.size() - len), len);
+        if ((idx % 5) == 0)
+            ba[len - 1] = char(rand() % 0x100);
+        int from = rand() % (_data.size() + 1);
+
+        if (_chunks.indexOf(ba, from) != _data.indexOf(ba, from))
+            errors += 1;
+        int lastFrom = from - ba.size();
+        qint64 expected = (lastFrom < 0) ? -1 : _data.lastIndexOf(ba, lastFrom);
+        if (_chunks.lastIndexOf(ba, from) != expected)
+            errors += 1;
+
+        // Small segments, so many threads meet in the data
+        ParallelSearch parallelSearch(_chunks.snapshot(), ba);
+        parallelSearch.setSegmentSize(rand() % 0x1000 + 1);
+        if (parallelSearch.indexOf(from) != _data.indexOf(ba, from))
+            errors += 1;
+        if (parallelSearch.lastIndexOf(from) != expected)
+            errors += 1;
+
+        // All matches, the overlapping ones too, and their lookup
+        QVector<qint64> all, part;
+        for (int pos = _data.indexOf(ba); pos >= 0; pos = _data.indexOf(ba, pos + 1))
+        {
+            all.append(pos);
+            if ((pos >= from) && (pos < (from + 1000)))
+                part.append(pos);
+        }
+        MatchIndex matches, parallelMatches;
+        _chunks.indexAll(ba, matches);
+        parallelSearch.indexAll(parallelMatches);
+        if ((matches.count() != all.size()) || (matches.range(0, _data.size()) != all))
+            errors += 1;
+        if (parallelMatches.range(0, _data.size()) != all)
+            errors += 1;
+        if (matches.range(from, from + 1000) != part)
+            errors += 1;
+        if (matches.next(from) != _data.indexOf(ba, from))
+            errors += 1;
+        if (matches.previous(from) != ((from > 0) ? _data.lastIndexOf(ba, from - 1) : -1))
+            errors += 1;
+    }
+
+    report("search", errors);
+}
+
+void TestChunks::replaceAll(int count)
+{
+    // Short patterns give many replacements, long replacements split chunks
+    int errors = 0;
+    for (int idx=0; idx < count; idx++)
+    {
+        int len = (idx % 2) ? rand() % 3 + 1 : rand() % 20 + 1;
+        QByteArray ba = _data.mid(rand() % (_data.size() - len), len);
+        QByteArray replacement;
+        int replacementLen = (idx % 7) ? rand() % 8 : rand() % 0x2000;
+        for (int bIdx=0; bIdx < replacementLen; bIdx++)
+            replacement += char(rand() % 0x100);
+
+        // A range finds the matches lying in it, the search starts at its begin
+        int from = rand() % _data.size();
+        int to = from + rand() % (_data.size() - from + 1);
+        MatchIndex ranged;
+        QVector<qint64> rangeFound;
+        _chunks.indexAll(ba, ranged, false, from, to);
+        for (int pos = _data.indexOf(ba, from); (pos >= 0) && (pos + ba.size() <= to); pos = _data.indexOf(ba, pos + ba.size()))
+            rangeFound.append(pos);
+        if (ranged.range(0, _data.size()) != rangeFound)
+            errors += 1;
+
+        MatchIndex positions;
+        _chunks.indexAll(ba, positions, false);
+        QByteArray oldData = _data;
+        QByteArray oldHighlighted = _highlighted;
+        QByteArray oldChanged;
+        _chunks.replaceAll(positions, ba.size(), replacement, QByteArray(), &oldChanged);
+
+        // The same replacements from behind, so the positions stay valid
+        QVector<qint64> found;
+        for (int pos = _data.indexOf(ba); pos >= 0; pos = _data.indexOf(ba, pos + ba.size()))
+            found.append(pos);
+        for (int fIdx=found.size() - 1; fIdx >= 0; fIdx--)
+        {
+            int pos = (int)found.at(fIdx);
+            _data.replace(pos, ba.size(), replacement);
+            _highlighted.replace(pos, ba.size(), QByteArray(replacement.size(), 1));
+            for (int bIdx=0; bIdx < ba.size(); bIdx++)
+                _byteChunks.removeAt(pos);
+            for (int bIdx=0; bIdx < replacement.size(); bIdx++)
+                _byteChunks.insert(pos + bIdx, replacement.at(bIdx));
+        }
+        if ((positions.range(0, oldData.size()) != found) || (oldChanged.size() != (found.size() * ba.size())))
+            errors += 1;
+        compare();
+
+        // Undo puts the pattern and its highlighting back, redo replaces again
+        MatchIndex replaced;
+        for (int fIdx=0; fIdx < found.size(); fIdx++)
+            replaced.append(found.at(fIdx) + fIdx * (replacement.size() - ba.size()));
+        QByteArray highlighted;
+        _chunks.replaceAll(replaced, replacement.size(), ba, oldChanged);
+        if ((_chunks.data(0, -1, &highlighted) != oldData) || (highlighted != oldHighlighted))
+            errors += 1;
+        _chunks.replaceAll(positions, ba.size(), replacement);
+        compare();
+    }
+
+    report("replaceAll", errors);
+}
+
+void TestChunks::viewLoader(int count)
+{
+    // The same source as a file, so both ways of reading the source are taken
+    FileSource source(_cData.data());
+    int errors = 0;
+
+    for (int idx=0; idx < count; idx++)
+    {
+        int pos = rand() % (_data.size() + 1);
+        int size = rand() % 0x3000;
+        ChunksSnapshot snapshot = _chunks.snapshot(pos, size);
+        QByteArray highlighted;
+        if ((ViewLoader::read(snapshot, pos, size, &highlighted) != _data.mid(pos, size))
+                || (highlighted != _highlighted.mid(pos, size)))
+            errors += 1;
+
+        snapshot.buffer.clear();
+        snapshot.fileName = source.file.fileName();
+        if ((ViewLoader::read(snapshot, pos, size, &highlighted) != _data.mid(pos, size))
+                || (highlighted != _highlighted.mid(pos, size)))
+            errors += 1;
+    }
+
+    report("viewLoader", errors);
+}
+
+void TestChunks::viewRequests()
+{
+    // A request is delivered once. While one is read, the next one waits and is replaced
+    // by the following one, a read, which does not cover them, is dropped. cancel()
+    // drops all of them. No event is processed in between, so the read has to wait.
+    ViewLoader loader;
+    ChangeRecorder recorder;
+    QObject::connect(&loader, SIGNAL(loaded(qint64,QByteArray,QByteArray)),
+                     &recorder, SLOT(loaded(qint64,QByteArray,QByteArray)));
+    int size = 0x8000;
+    int errors = 0;
+
+    loader.load(_chunks.snapshot(0x1000, size), 0x1000, size);
+    loader.waitForLoaded();
+    if ((recorder.loadedPos != (QList<qint64>() << 0x1000)) || (recorder.loadedData.at(0) != _data.mid(0x1000, size)))
+        errors += 1;
+
+    recorder.loadedPos.clear();
+    recorder.loadedData.clear();
+    loader.load(_chunks.snapshot(0, size), 0, size);
+    loader.load(_chunks.snapshot(size, size), size, size);
+    loader.load(_chunks.snapshot(2 * size, size), 2 * size, size);
+    loader.waitForLoaded();
+    if ((recorder.loadedPos != (QList<qint64>() << 2 * size)) || (recorder.loadedData.at(0) != _data.mid(2 * size, size)))
+        errors += 1;
+
+    recorder.loadedPos.clear();
+    recorder.loadedData.clear();
+    loader.load(_chunks.snapshot(0, 2 * size), 0, 2 * size);
+    loader.load(_chunks.snapshot(size, size), size, size);
+    loader.waitForLoaded();
+    if ((recorder.loadedPos != (QList<qint64>() << 0)) || (recorder.loadedData.at(0) != _data.mid(0, 2 * size)))
+        errors += 1;
+
+    recorder.loadedPos.clear();
+    loader.load(_chunks.snapshot(0, size), 0, size);
+    loader.load(_chunks.snapshot(3 * size, size), 3 * size, size);
+    loader.cancel();
+    loader.waitForLoaded();
+    if (!recorder.loadedPos.isEmpty() || !loader.canceled())
+        errors += 1;
+
+    report("viewRequests", errors);
+}
+
+void TestChunks::viewPrefetch(int count)
+{
+    // Paging down and up with a loader, which delivers every range one move late. The
+    // range lies ahead in the direction of the moves, so all of them are hits.
+    const qint64 screen = 0x400;
+    const qint64 dataSize = _data.size();
+    ViewPrefetch prefetch;
+    qint64 pos = dataSize / 2;
+    qint64 loadedBegin = pos;                   // the view was read at once
+    qint64 loadedEnd = pos + screen;
+    qint64 begin = 0, end = 0;
+    prefetch.setRequested(loadedBegin, loadedEnd);
+    bool waiting = prefetch.request(pos, screen, 16, dataSize, begin, end);
+    int errors = 0;
+    for (int idx=0; idx < 2 * count; idx++)
+    {
+        int direction = (idx < count) ? 1 : -1;
+        qint64 newPos = pos + direction * screen;
+        if (waiting)
+        {
+            loadedBegin = begin;
+            loadedEnd = end;
+            waiting = false;
+        }
+        prefetch.moved(pos, newPos, (newPos >= loadedBegin) && ((newPos + screen) <= loadedEnd));
+        pos = newPos;
+        if (prefetch.request(pos, screen, 16, dataSize, begin, end))
+        {
+            waiting = true;
+            qint64 before = pos - begin;
+            qint64 after = end - pos - screen;
+            if ((prefetch.direction() != direction) || ((direction > 0) ? (after <= before) : (before <= after)))
+                errors += 1;
+        }
+    }
+    if ((prefetch.hits() != 2 * count) || (prefetch.misses() != 0))
+        errors += 1;
+
+    // A jump misses, the screens ahead are as big as the jump, the budget cuts them
+    prefetch.moved(pos, pos - 8 * screen, false);
+    pos -= 8 * screen;
+    prefetch.setScreens(2);
+    prefetch.setBudget(0x100000);
+    if (!prefetch.request(pos, screen, 16, dataSize, begin, end) || (prefetch.misses() != 1)
+            || (begin != qMax<qint64>(pos - 16 * screen, 0)) || (end != (pos + screen + 4 * screen)))
+        errors += 1;
+    prefetch.setBudget(screen);
+    prefetch.moved(pos, pos + screen, true);
+    pos += screen;
+    prefetch.setRequested(pos, pos + screen);
+    if (!prefetch.request(pos, screen, 16, dataSize, begin, end) || ((end - begin) > (2 * screen)))
+        errors += 1;
+
+    report("viewPrefetch", errors);
+}
+
+void TestChunks::memoryBudget(qint64 budget, int count)
+{
+    // Edits beyond the budget spill chunks, every compare() loads them again
+    _chunks.setMemoryBudget(budget);
+    randomBlocks(count);
+    int errors = 0;
+    if ((_chunks.spilledSize() == 0) || (_chunks.residentSize() > budget))
+        errors += 1;
+
+    report("memoryBudget", errors);
+}
+
+void TestChunks::spillLost()
+{
+    // A spill file, which lost its data, gives back no zeros: reads end in front
+    // of the lost chunk, edits there and writes fail. The data is not usable after.
+    int errors = 0;
+    ChunkSpill *spill = _chunks.spillFile();
+    if (!spill || (_chunks.spilledSize() == 0))
+        errors += 1;
+    else
+    {
+        spill->waitForWritten();
+        QFile::resize(spill->fileName(), 0);
+        QByteArray data = _chunks.data();
+        if ((data.size() >= _data.size()) || (data != _data.left(data.size())))
+            errors += 1;
+        if (_chunks.overwrite(data.size(), 'x') || !_chunks.data(data.size(), 1).isEmpty())
+            errors += 1;
+        QBuffer out;
+        if (_chunks.write(out))
+            errors += 1;
+    }
+
+    report("spillLost", errors);
+}
+
+void TestChunks::compaction(int count)
+{
+    // Inserts at one place must not grow a chunk without limit. Removing them again
+    // and writing back the original data leaves the chunks, which were there before.
+    int errors = 0;
+    int chunks = _chunks.chunkSize();
+    int pos = rand() % (_data.size() - count);
+    for (int idx=0; idx < count; idx++)
+    {
+        char b = char(rand() % 0x100);
+        _data.insert(pos + idx, b);
+        _highlighted.insert(pos + idx, 1);
+        _chunks.insert(pos + idx, b);
+        _byteChunks.insert(pos + idx, b);
+    }
+    if (_chunks.maxChunkSize() > 0x2000)
+        errors += 1;
+    compare();
+    for (int idx=0; idx < count; idx++)
+    {
+        _data.remove(pos, 1);
+        _highlighted.remove(pos, 1);
+        _chunks.removeAt(pos);
+        _byteChunks.removeAt(pos);
+    }
+    if (_chunks.chunkSize() > chunks)
+        errors += 1;
+    compare();
+
+    QByteArray old = _data.mid(pos, count);
+    QByteArray oldHighlighted = _highlighted.mid(pos, count);
+    overwrite(pos, QByteArray(count, '.'));
+    _data.replace(pos, count, old);
+    _highlighted.replace(pos, count, oldHighlighted);
+    _chunks.overwrite(pos, old);
+    _chunks.setDataChanged(pos, oldHighlighted);
+    _byteChunks.overwrite(pos, old);
+    _byteChunks.setDataChanged(pos, oldHighlighted);
+    if (_chunks.chunkSize() > chunks)
+        errors += 1;
+    compare();
+
+    // Removed bytes leave small chunks behind, which are merged, so the number of
+    // chunks follows the size of the edited span
+    for (int idx=0; idx < count; idx += 2)
+    {
+        _data.remove(pos + idx / 2, 1);
+        _highlighted.remove(pos + idx / 2, 1);
+        _chunks.removeAt(pos + idx / 2);
+        _byteChunks.removeAt(pos + idx / 2);
+    }
+    compare();
+    if (_chunks.chunkSize() > (chunks + count / 0x1000 + 2))
+        errors += 1;
+
+    report("compaction", errors);
+}
+
+void TestChunks::writeChanges(qint64 budget, int count)
+{
+    // Overwrites are patched into a copy of the source, spilled chunks too. After an
+    // insert nothing is written, until it is removed again.
+    _chunks.setMemoryBudget(budget);
+    for (int idx=0; idx < count; idx++)
+    {
+        int size = rand() % 0x400 + 1;
+        int pos = rand() % (_data.size() - size);
+        QByteArray ba;
+        for (int b=0; b < size; b++)
+            ba += char(rand() % 0x100);
+        overwrite(pos, ba);
+    }
+    int errors = 0;
+    QBuffer patched;
+    patched.setData(_copy);
+    if (!_chunks.writeChanges(patched) || (patched.data() != _data))
+        errors += 1;
+
+    int pos = rand() % _data.size();
+    insert(pos, QByteArray(3, 'i'));
+    patched.setData(_copy);
+    if (_chunks.writeChanges(patched) || (patched.data() != _copy))
+        errors += 1;
+    remove(pos, 3);
+    if (!_chunks.writeChanges(patched) || (patched.data() != _data))
+        errors += 1;
+
+    report("writeChanges", errors);
+}
+
+void TestChunks::undoBudget(qint64 budget, int count)
+{
+    // Range edits through an UndoStack beyond its budget. The first half inserts
+    // bytes, which the pool compresses, so all steps stay. The second half is random
+    // and drops the oldest steps off the stack. The steps are undone and redone.
+    UndoStack stack(&_chunks);
+    stack.setMemoryBudget(budget);
+    QList<QByteArray> states;
+    states.append(_chunks.data());
+    int errors = 0;
+    for (int idx=0; idx < count; idx++)
+    {
+        int size = rand() % 0x2000 + 0x1000;
+        int pos = rand() % (int)(_chunks.size() - size);
+        QByteArray ba;
+        for (int b=0; b < size; b++)
+            ba += (idx < count / 2) ? char('a' + (b / 0x100) % 26) : char(rand() % 0x100);
+        if ((idx < count / 2) || ((idx % 3) == 0))
+            stack.insert(pos, ba);
+        else if ((idx % 3) == 1)
+            stack.overwrite(pos, size, ba);
+        else
+            stack.removeAt(pos, size);
+        states.append(_chunks.data());
+
+        if (idx == (count / 2 - 1))
+        {
+            stack.waitForPool();
+            if ((stack.index() != count / 2) || stack.trimmed() || (stack.memoryUsage() > budget))
+                errors += 1;
+            stack.setIndex(0);
+            if (_chunks.data() != states.at(0))
+                errors += 1;
+            stack.setIndex(count / 2);
+            if (_chunks.data() != states.at(count / 2))
+                errors += 1;
+        }
+    }
+    stack.waitForPool();
+    if (!stack.trimmed() || (stack.index() >= count) || (stack.count() != stack.index())
+            || (stack.memoryUsage() > budget))
+        errors += 1;
+
+    // QUndoStack itself can not reach the dropped steps. Redo reads the replaced bytes
+    // again, so it may drop more of them, the kept steps are always the newest ones.
+    stack.setIndex(0);
+    if (stack.canUndo() || (_chunks.data() != states.at(count - stack.count())))
+        errors += 1;
+    while (stack.canRedo())
+    {
+        stack.redo();
+        if (_chunks.data() != states.at(count - stack.count() + stack.index()))
+            errors += 1;
+    }
+    while (stack.canUndo())
+    {
+        stack.undo();
+        if (_chunks.data() != states.at(count - stack.count() + stack.index()))
+            errors += 1;
+    }
+    stack.clear();
+    if ((stack.memoryUsage() != 0) || stack.trimmed())
+        errors += 1;
+
+    report("undoBudget", errors);
+}
+
+void TestChunks::undoJournal(int count)
+{
+    // Steps with 64 KiB and more, whose data is in the journal. It is switched off and
+    // on again in the middle of the history, at last a budget drops the oldest steps,
+    // their garbage makes the stack write the journal anew.
+    UndoStack stack(&_chunks);
+    stack.setJournal(true);
+    QList<QByteArray> states;
+    states.append(_chunks.data());
+    int errors = 0;
+    for (int idx=0; idx < count; idx++)
+    {
+        pushStep(stack, idx, 0x10000 + rand() % 0x4000);
+        states.append(_chunks.data());
+    }
+    if (!stack.journal() || (stack.journalSize() < (qint64)count * 0x10000)
+            || (stack.memoryUsage() >= 0x10000))
+        errors += 1;
+    errors += undoRedo(stack, states, 0);
+
+    // Off in the middle, the data is read back into memory
+    stack.setIndex(count / 2);
+    stack.setJournal(false);
+    if (stack.journal() || (stack.journalSize() != 0) || (stack.memoryUsage() < (qint64)count * 0x10000))
+        errors += 1;
+    errors += undoRedo(stack, states, 0);
+
+    // On again, the steps behind the index are deleted by the next push
+    stack.setIndex(count / 4);
+    stack.setJournal(true);
+    if ((stack.journalSize() < (qint64)count * 0x10000) || (stack.memoryUsage() >= 0x10000))
+        errors += 1;
+    pushStep(stack, count, 0x10000);
+    while (states.size() > (count / 4 + 1))
+        states.removeLast();
+    states.append(_chunks.data());
+    if (stack.journalFile()->garbage() * 2 > stack.journalFile()->size())
+        errors += 1;
+    errors += undoRedo(stack, states, 0);
+
+    // The budget holds some commands only, the dropped ones are garbage in the journal
+    stack.setMemoryBudget(0x400);
+    for (int idx=0; idx < count; idx++)
+    {
+        pushStep(stack, idx, 0x10000 + rand() % 0x4000);
+        states.append(_chunks.data());
+    }
+    if (!stack.trimmed() || (stack.count() >= count) || (stack.memoryUsage() > 0x400)
+            || (stack.journalFile()->garbage() * 2 > stack.journalFile()->size()))
+        errors += 1;
+    errors += undoRedo(stack, states, states.size() - 1 - stack.count());
+    stack.clear();
+    if ((stack.journalSize() != 0) || (stack.memoryUsage() != 0))
+        errors += 1;
+
+    report("undoJournal", errors);
+}
+
+void TestChunks::editSteps(int count)
+{
+    // A paste and a replacement, which changes the size, are one step each, so the
+    // transaction of QHexEdit emits dataChanged() once and undo takes them back at once
+    UndoStack stack(&_chunks);
+    ChangeRecorder recorder;
+    QObject::connect(&stack, SIGNAL(indexChanged(int)), &recorder, SLOT(indexChanged(int)));
+    QObject::connect(&_chunks, SIGNAL(contentsChanged(qint64,qint64,qint64)),
+                     &recorder, SLOT(contentsChanged(qint64,qint64,qint64)));
+    QByteArray first = _chunks.data();
+    int errors = 0;
+    for (int idx=0; idx < count; idx++)
+    {
+        QByteArray data = _chunks.data();
+        int len = rand() % 0x100 + 1;
+        int pos = rand() % (data.size() - len);
+        QByteArray ba;
+        for (int b = rand() % 0x200; b >= 0; b--)
+            ba += char(rand() % 0x100);
+        recorder.steps = 0;
+        recorder.change = ContentsChange();
+        if (idx % 2)
+        {
+            stack.insert(pos, ba);
+            len = 0;
+        }
+        else
+            stack.overwrite(pos, len, ba);
+        if ((recorder.steps != 1) || (recorder.change.pos != pos) || (recorder.change.removed != len)
+                || (recorder.change.added != ba.size()) || (_chunks.data() != data.replace(pos, len, ba)))
+            errors += 1;
+        stack.undo();
+        if ((recorder.steps != 2) || (_chunks.size() != (data.size() - ba.size() + len)))
+            errors += 1;
+        stack.redo();
+    }
+    recorder.steps = 0;
+    stack.setIndex(0);
+    if ((recorder.steps != 1) || (_chunks.data() != first))
+        errors += 1;
+
+    report("editSteps", errors);
+}
+
+void TestChunks::bigFile(qint64 fileSize)
+{
+    // A sparse file, so positions above 4 GiB cost no disk space. Every edit
+    // is checked at its position and at the positions it moves.
+    FileSource source(QByteArray(), fileSize);
+    Chunks &chunks = source.chunks;
+    int errors = 0;
+
+    const qint64 high = Q_INT64_C(0x100000000) + 10;
+    const qint64 low = Q_INT64_C(0x80000000) - 1;
+    QByteArray highlighted;
+    chunks.overwrite(high, QByteArray("abc"));
+    if ((chunks.data(high - 2, 7, &highlighted) != QByteArray("\0\0abc\0\0", 7))
+            || (highlighted != QByteArray("\0\0\1\1\1\0\0", 7)))
+        errors += 1;
+
+    // Inserting and removing in front moves the data above 4 GiB
+    QByteArray ba(5000, 'x');
+    chunks.insert(low, ba);
+    if ((chunks.size() != (fileSize + ba.size())) || (chunks.data(high + ba.size(), 3) != "abc"))
+        errors += 1;
+    chunks.remove(low + 1000, 0x3000);
+    qint64 moved = high + ba.size() - 0x3000;
+    if ((chunks.data(moved, 3) != "abc") || (chunks.data(low + 999, 2) != QByteArray("x\0", 2)))
+        errors += 1;
+
+    // Search and replace behind the 4 GiB border
+    if ((chunks.indexOf("abc", moved - 0x100000) != moved) || (chunks.lastIndexOf("abc", moved + 0x100000) != moved))
+        errors += 1;
+    qint64 size = chunks.size();
+    MatchIndex positions;
+    positions.append(moved);
+    positions.append(size - 3);
+    chunks.overwrite(size - 3, QByteArray("abc"));
+    chunks.replaceAll(positions, 3, "zz");
+    if ((chunks.size() != (size - 2)) || (chunks.data(moved - 1, 4) != QByteArray("\0zz\0", 4))
+            || (chunks.data(size - 5, 3) != QByteArray("\0zz", 3)))
+        errors += 1;
+
+    // Wholly changed chunks need no bits, undo gives back the highlighting as ranges
+    qint64 memory = chunks.changedMemory();
+    ChangedRanges ranges;
+    QByteArray old = chunks.data(low - 0x80000, 0x100000, &ranges);
+    chunks.overwrite(low - 0x80000, QByteArray(0x100000, 'y'));
+    if (chunks.changedMemory() > (memory + 0x400))
+        errors += 1;
+    chunks.overwrite(low - 0x80000, old);
+    chunks.setDataChanged(low - 0x80000, old.size(), ranges);
+    QByteArray highlighted2;
+    if ((chunks.data(low + 999, 2, &highlighted2) != QByteArray("x\0", 2))
+            || (highlighted2 != QByteArray("\1\0", 2)) || (chunks.dataChanged(low - 0x80000)))
+        errors += 1;
+
+    report("bigFile", errors);
+}
+
+void TestChunks::bigEdits(qint64 fileSize)
+{
+    // The undo steps of cut, delete, backspace and typing over a selection in
+    // QHexEdit behind 4 GiB of a sparse file. A selection too large for a QByteArray
+    // is refused without a change.
+    FileSource source(QByteArray(), fileSize);
+    Chunks &chunks = source.chunks;
+    UndoStack stack(&chunks);
+    int errors = 0;
+
+    const qint64 high = Q_INT64_C(0x100000000) + 10;
+    const qint64 len = 0x100000;
+    stack.overwrite(high + len, 3, QByteArray("abc"));
+
+    // Overwrite mode zeroes the selection, insert mode removes it
+    stack.overwrite(high, len, QByteArray(len, 'y'));
+    if ((chunks.size() != fileSize) || (chunks.data(high - 1, 2) != QByteArray("\0y", 2))
+            || (chunks.data(high + len - 1, 4) != "yabc"))
+        errors += 1;
+    stack.removeAt(high, len);
+    if ((chunks.size() != (fileSize - len)) || (chunks.data(high - 1, 4) != QByteArray("\0abc", 4)))
+        errors += 1;
+    stack.undo();
+    if ((chunks.size() != fileSize) || (chunks.data(high + len - 1, 4) != "yabc"))
+        errors += 1;
+    stack.undo();
+    if ((chunks.data(high, 1) != QByteArray(1, char(0))) || (chunks.data(high + len, 3) != "abc"))
+        errors += 1;
+
+    // More than 2 GiB across the 4 GiB border
+    const qint64 big = Q_INT64_C(0x90000000);
+    int index = stack.index();
+    stack.removeAt(high - big + 0x1000, big);
+    stack.overwrite(high - big + 0x1000, big, QByteArray(16, 'z'));
+    if ((stack.index() != index) || (chunks.size() != fileSize) || (chunks.data(high + len, 3) != "abc")
+            || (chunks.data(high - big + 0x1000, 16) != QByteArray(16, char(0))))
+        errors += 1;
+
+    report("bigEdits", errors);
+}
+
+void TestChunks::report(const QString &name, int errors)
+{
+    _tCnt += 1;
+    QString tName = QString("logs/%1_%2_%3").arg(_tName).arg(_tCnt).arg(name);
+    if (errors > 0)
+    {
+        qDebug() << "NOK " << tName << errors;
+        *_log << "NOK " << tName << " " << errors << "\n";
+    }
+    else
+    {
+        qDebug() << "OK " << tName;
+        *_log << "OK " << tName << "\n";
+    }
+}
+
+void TestChunks::pushStep(UndoStack &stack, int idx, int size)
+{
+    int pos = rand() % (int)(_chunks.size() - size);
+    QByteArray ba;
+    for (int b=0; b < size; b++)
+        ba += char(rand() % 0x100);
+    if ((idx % 3) == 0)
+        stack.insert(pos, ba);
+    else if ((idx % 3) == 1)
+        stack.overwrite(pos, size, ba);
+    else
+        stack.removeAt(pos, size);
+}
+
+int TestChunks::undoRedo(UndoStack &stack, const QList<QByteArray> &states, int first)
+{
+    // Every step is undone and redone, states.at(first) is the data at index 0
+    int errors = 0;
+    int index = stack.index();
+    while (stack.canUndo())
+    {
+        stack.undo();
+        if (_chunks.data() != states.at(first + stack.index()))
+            errors += 1;
+    }
+    while (stack.canRedo())
+    {
+        stack.redo();
+        if (_chunks.data() != states.at(first + stack.index()))
+            errors += 1;
+    }
+    stack.setIndex(index);
+    if (_chunks.data() != states.at(first + index))
+        errors += 1;
+    return errors;
+}
+
 void TestChunks::insert(qint64 pos, char b)
 {
     _data.insert((int)pos, b);
     _copy.insert((int)pos, char(0));
     _highlighted.insert((int)pos, 1);
     _chunks.insert(pos, b);
+    _byteChunks.insert(pos, b);
     compare();
 }
 
@@ -60,6 +806,7 @@ void TestChunks::overwrite(qint64 pos, char b)
     _data[(int)pos] = b;
     _highlighted[(int)pos] = 1;
     _chunks.overwrite(pos, b);
+    _byteChunks.overwrite(pos, b);
     compare();
 }
 
@@ -68,6 +815,37 @@ void TestChunks::removeAt(qint64 pos)
     _data.remove((int)pos, 1);
     _highlighted.remove((int)pos, 1);
     _chunks.removeAt(pos);
+    _byteChunks.removeAt(pos);
+    compare();
+}
+
+void TestChunks::insert(qint64 pos, const QByteArray &ba)
+{
+    _data.insert((int)pos, ba);
+    _highlighted.insert((int)pos, QByteArray(ba.size(), 1));
+    _chunks.insert(pos, ba);
+    for (int idx=0; idx < ba.size(); idx++)
+        _byteChunks.insert(pos + idx, ba.at(idx));
+    compare();
+}
+
+void TestChunks::overwrite(qint64 pos, const QByteArray &ba)
+{
+    _data.replace((int)pos, ba.size(), ba);
+    _highlighted.replace((int)pos, ba.size(), QByteArray(ba.size(), 1));
+    _chunks.overwrite(pos, ba);
+    for (int idx=0; idx < ba.size(); idx++)
+        _byteChunks.overwrite(pos + idx, ba.at(idx));
+    compare();
+}
+
+void TestChunks::remove(qint64 pos, qint64 len)
+{
+    _data.remove((int)pos, (int)len);
+    _highlighted.remove((int)pos, (int)len);
+    _chunks.remove(pos, len);
+    for (qint64 idx=0; idx < len; idx++)
+        _byteChunks.removeAt(pos);
     compare();
 }
 
@@ -75,18 +853,60 @@ void TestChunks::compare()
 {
     QByteArray rHighLighted;
     QByteArray rData = _chunks.data(0, -1, &rHighLighted);
-    bool error = false;
+    int errors = 0;
 
     if (rData != _data)
-        error = true;
+        errors += 1;
     if (rHighLighted != _highlighted)
-        error = true;
+        errors += 1;
 
-    _tCnt += 1;
+    // Byte array manipulations have to be equivalent to the char manipulations
+    QByteArray bHighlighted;
+    if ((_byteChunks.data(0, -1, &bHighlighted) != rData) || (bHighlighted != rHighLighted))
+        errors += 1;
 
-    int chunkSize = _chunks.chunkSize();
-    QString tName = QString("logs/%1_%2_%3").arg(_tName).arg(_tCnt).arg(chunkSize);
-    if (error || (_tCnt >= _saveFile))
+    // The changed ranges have to describe the same highlighting
+    ChangedRanges ranges;
+    QByteArray rangesHighlighted(rData.size(), char(0));
+    if (_chunks.data(0, -1, &ranges) != rData)
+        errors += 1;
+    for (int idx=0; idx < ranges.size(); idx++)
+        rangesHighlighted.replace((int)ranges.at(idx).pos, (int)ranges.at(idx).size,
+                                  QByteArray((int)ranges.at(idx).size, char(1)));
+    if (rangesHighlighted != rHighLighted)
+        errors += 1;
+
+    // write() has to stream the same data, a part of it too
+    QBuffer written, writtenPart;
+    if (!_chunks.write(written) || (written.data() != rData))
+        errors += 1;
+    qint64 third = rData.size() / 3;
+    if (!_chunks.write(writtenPart, third, third) || (writtenPart.data() != rData.mid((int)third, (int)third)))
+        errors += 1;
+    if ((_chunks.memoryBudget() > 0) && (_chunks.residentSize() > _chunks.memoryBudget()))
+        errors += 1;
+
+    // The signalled range has to explain all changes since the last compare
+    ContentsChange change = _recorder.change;
+    if (change.pos >= 0)
+    {
+        int pos = (int)change.pos;
+        int tail = _compared.size() - pos - (int)change.removed;
+        if ((pos > _compared.size()) || (tail < 0)
+                || (_compared.size() - change.removed + change.added != rData.size())
+                || (_compared.left(pos) != rData.left(pos))
+                || (_compared.right(tail) != rData.right(tail)))
+            errors += 1;
+    }
+    else if (_compared != rData)
+        errors += 1;
+    _compared = rData;
+    _recorder.change = ContentsChange();
+
+    // The data is saved under the name, which report() logs
+    QString chunkSize = QString::number(_chunks.chunkSize());
+    QString tName = QString("logs/%1_%2_%3").arg(_tName).arg(_tCnt + 1).arg(chunkSize);
+    if ((errors > 0) || ((_tCnt + 1) >= _saveFile))
     {
         QFile file1(tName + "_data.txt");
         file1.open(QIODevice::WriteOnly);
@@ -109,15 +929,5 @@ void TestChunks::compare()
         file4.close();
     }
 
-    if (error)
-    {
-        qDebug() << "NOK " << tName;
-        *_log << "NOK " << tName << "\n";
-    }
-    else
-    {
-        qDebug() << "OK " << tName;
-        *_log << "OK " << tName << "\n";
-    }
-
+    report(chunkSize, errors);
 }
@@ -4,9 +4,41 @@
 #include <QBuffer>
 #include <QByteArray>
 #include <QString>
+#include <QTemporaryFile>
 #include <QTextStream>
 
 #include "../src/chunks.h"
+#include "../src/commands.h"
+#include "../src/parallelsearch.h"
+#include "../src/viewloader.h"
+
+// Merges the contentsChanged() signals of Chunks between two compares and counts
+// the index changes of an UndoStack, which QHexEdit turns into dataChanged()
+class ChangeRecorder : public QObject
+{
+Q_OBJECT
+public slots:
+    void contentsChanged(qint64 pos, qint64 removed, qint64 added);
+    void indexChanged(int idx);
+    void loaded(qint64 pos, const QByteArray &data, const QByteArray &highlighted);
+
+public:
+    ChangeRecorder() : steps(0) {}
+    ContentsChange change;
+    int steps;
+    QList<qint64> loadedPos;                    // results of a ViewLoader
+    QList<QByteArray> loadedData;
+};
+
+// A temporary file as source of Chunks. It holds data and is extended up to size,
+// the extension is sparse.
+class FileSource
+{
+public:
+    FileSource(const QByteArray &data, qint64 size=0);
+    QTemporaryFile file;
+    Chunks chunks;
+};
 
 class TestChunks
 {
@@ -15,14 +47,39 @@ public:
     void insert(qint64 pos, char b);
     void overwrite(qint64 pos, char b);
     void removeAt(qint64 pos);
+    void insert(qint64 pos, const QByteArray &ba);
+    void overwrite(qint64 pos, const QByteArray &ba);
+    void remove(qint64 pos, qint64 len);
     void random(int count);
+    void randomBlocks(int count);
+    void search(int count);
+    void replaceAll(int count);
+    void viewLoader(int count);
+    void viewRequests();
+    void viewPrefetch(int count);
+    void memoryBudget(qint64 budget, int count);
+    void spillLost();
+    void compaction(int count);
+    void writeChanges(qint64 budget, int count);
+    void undoBudget(qint64 budget, int count);
+    void undoJournal(int count);
+    void editSteps(int count);
+    void bigFile(qint64 fileSize);
+    void bigEdits(qint64 fileSize);
     void compare();
 
 
 private:
+    void report(const QString &name, int errors);
+    void pushStep(UndoStack &stack, int idx, int size);
+    int undoRedo(UndoStack &stack, const QList<QByteArray> &states, int first);
+
     QByteArray _data, _highlighted, _copy;
     QBuffer _cData;
     Chunks _chunks;
+    Chunks _byteChunks;                         // same edits byte by byte
+    ChangeRecorder _recorder;                   // changes of _chunks since _compared
+    QByteArray _compared;                       // data of _chunks at the last compare
     int _tCnt;
     QString _tName;
     int _saveFile;